@@ -0,0 +1,60 @@
+#ifndef ALIGNED_BUFFER_H
+#define ALIGNED_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+// Heap buffer aligned (and sized) to the page size so it can be used for
+// large sequential reads and O_DIRECT transfers
+class AlignedBuffer {
+public:
+    static constexpr std::size_t kAlignment = 4096;
+
+    AlignedBuffer() = default;
+
+    explicit AlignedBuffer(std::size_t size)
+        : m_size(roundUp(size)),
+          m_data(static_cast<uint8_t*>(::operator new(m_size, std::align_val_t{kAlignment}))) {}
+
+    ~AlignedBuffer() { release(); }
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    AlignedBuffer(AlignedBuffer&& other) noexcept
+        : m_size(std::exchange(other.m_size, 0)),
+          m_data(std::exchange(other.m_data, nullptr)) {}
+
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept {
+        if (this != &other) {
+            release();
+            m_size = std::exchange(other.m_size, 0);
+            m_data = std::exchange(other.m_data, nullptr);
+        }
+        return *this;
+    }
+
+    uint8_t* data() { return m_data; }
+    const uint8_t* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+
+    // Round a length up to a multiple of kAlignment (at least one block)
+    static std::size_t roundUp(std::size_t size) {
+        if (size == 0) return kAlignment;
+        return (size + kAlignment - 1) / kAlignment * kAlignment;
+    }
+
+private:
+    void release() {
+        if (m_data) ::operator delete(m_data, std::align_val_t{kAlignment});
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    std::size_t m_size = 0;
+    uint8_t* m_data = nullptr;
+};
+
+#endif
@@ -1,23 +1,132 @@
 #ifndef COPY_TOOL_H
 #define COPY_TOOL_H
 
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <string>
+#include <system_error>
+#include <vector>
 
 namespace fs = std::filesystem;
 
+class ProgressMeter;
+class SHA256;
+
+// Buffer size of the read/write loop, the last copy strategy
+constexpr std::size_t kCopyBufferSize = 1024 * 1024;
+
+// --reflink: auto tries a copy-on-write clone first and falls back to
+// copying; always fails if the clone is not possible; never skips both the
+// clone and copy_file_range (which may clone implicitly)
+enum class ReflinkMode { Auto, Always, Never };
+
+// --sparse: auto keeps the holes of sparse sources (found with SEEK_DATA /
+// SEEK_HOLE); always also turns zero-filled blocks into holes; never writes
+// every byte
+enum class SparseMode { Auto, Always, Never };
+
+// --direct streams through kDirectPipelineDepth aligned buffers of this
+// size: one is read while the previous ones are written
+constexpr std::size_t kDirectBufferSize = 4 * 1024 * 1024;
+constexpr std::size_t kDirectPipelineDepth = 3;
+
+// How the data of a file was copied, in the order they are tried; Delta
+// rewrites changed blocks of an existing destination (--delta); Direct and
+// Uncached are the --direct paths, with and without O_DIRECT
+enum class CopyStrategy { None, Reflink, Sparse, CopyFileRange, Sendfile, ReadWrite, Delta, Direct, Uncached };
+
+// --delta block size bounds (rsync's): blocks are about sqrt(file size)
+constexpr std::size_t kDeltaMinBlockSize = 700;
+constexpr std::size_t kDeltaMaxBlockSize = 128 * 1024;
+
 struct CopyCommand {
     std::string sourcePath;
     std::string destinationPath;
     bool recursive = false;
     bool force = false;
+    bool verbose = false;
+    std::string reflink = "auto";
+    std::string sparse = "auto";
+    unsigned jobs = 1;
+    bool update = false;
+    bool checksum = false;
+    bool deleteExtraneous = false;
+    bool delta = false;
+    bool progress = false;
+    bool verify = false;
+    bool verifyDirect = false;
+    std::string manifest;
+    bool preserveLinks = false;
+    bool direct = false;
 
     void run() const;
 };
 
+struct CopyOptions {
+    bool force = false;
+    bool recursive = false;
+    bool verbose = false;               // report the strategy used per file
+    ReflinkMode reflink = ReflinkMode::Auto;
+    SparseMode sparse = SparseMode::Auto;
+    unsigned jobs = 1;                  // directory copy workers (0 = one per core)
+    bool update = false;                // skip files with the same size and mtime
+    bool checksum = false;              // skip files with the same size and contents
+    bool deleteExtraneous = false;      // remove destination entries missing from the source
+    bool delta = false;                 // rewrite only changed blocks of existing files
+    ProgressMeter* progress = nullptr;  // --progress counters, null when off
+    bool verify = false;                // hash while copying, then re-read and compare
+    bool verifyDirect = false;          // re-read with O_DIRECT (bypass the page cache)
+    bool preserveLinks = false;         // recreate hard links among copied files
+    bool direct = false;                // copy without filling the page cache
+};
+
+// SHA-256 of one copied file, for the --manifest output
+struct CopyDigest {
+    fs::path path;                      // destination path
+    std::string sha256;
+};
+
+// Outcome of a delta update
+struct DeltaResult {
+    std::size_t blockSize = 0;
+    std::size_t blocks = 0;             // source blocks compared
+    std::size_t blocksRewritten = 0;
+    std::uintmax_t bytesWritten = 0;
+};
+
+// Totals of one directory copy
+struct CopyReport {
+    std::size_t filesCopied = 0;
+    std::size_t filesUnchanged = 0;     // skipped by --update / --checksum
+    std::size_t entriesDeleted = 0;
+    std::size_t linksCreated = 0;       // --preserve-links: paths linked instead of copied
+    std::uintmax_t bytesCopied = 0;
+    std::size_t errors = 0;
+    std::vector<CopyDigest> digests;    // with verify, one per destination file
+};
+
 // Copy tool helper functions
 bool pathExists(const fs::path& p);
+bool parseReflinkMode(const std::string& name, ReflinkMode& mode);
+bool parseSparseMode(const std::string& name, SparseMode& mode);
+const char* copyStrategyName(CopyStrategy strategy);
+CopyStrategy copyFileData(const fs::path& src, const fs::path& dst, ReflinkMode reflink, std::error_code& ec);
+CopyStrategy copyFileData(const fs::path& src, const fs::path& dst, ReflinkMode reflink, SparseMode sparse,
+                          std::error_code& ec, ProgressMeter* progress = nullptr, SHA256* digest = nullptr);
+CopyStrategy copyFileData(const fs::path& src, const fs::path& dst, const CopyOptions& options, std::error_code& ec,
+                          SHA256* digest = nullptr);
 bool copySingleFile(const fs::path& src, const fs::path& dst, bool force);
+bool copySingleFile(const fs::path& src, const fs::path& dst, const CopyOptions& options);
+bool copySingleFile(const fs::path& src, const fs::path& dst, const CopyOptions& options, CopyReport& report);
 bool copyDirectory(const fs::path& src, const fs::path& dst, bool force, bool recursive);
+bool copyDirectory(const fs::path& src, const fs::path& dst, const CopyOptions& options);
+bool copyDirectory(const fs::path& src, const fs::path& dst, const CopyOptions& options, CopyReport& report);
+bool destinationUpToDate(const fs::path& src, const fs::path& dst, bool compareContents);
+std::size_t deltaBlockSize(std::uintmax_t fileSize);
+bool deltaCopyFile(const fs::path& src, const fs::path& dst, DeltaResult& result, std::error_code& ec,
+                   SHA256* sourceDigest = nullptr);
+bool hashStoredFile(const fs::path& path, bool direct, std::string& hex, std::error_code& ec);
+bool writeCopyManifest(const fs::path& manifestPath, std::vector<CopyDigest> digests, std::error_code& ec);
 
-#endif
\ No newline at end of file
+#endif
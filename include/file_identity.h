@@ -0,0 +1,117 @@
+#ifndef FILE_IDENTITY_H
+#define FILE_IDENTITY_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// (device, inode) pair identifying a file independently of its path
+struct FileId {
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+
+    bool operator==(const FileId& other) const {
+        return device == other.device && inode == other.inode;
+    }
+};
+
+struct FileIdHash {
+    std::size_t operator()(const FileId& id) const noexcept {
+        // splitmix64 finalizer over both halves
+        std::uint64_t x = id.inode ^ (id.device * 0x9e3779b97f4a7c15ull);
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return static_cast<std::size_t>(x);
+    }
+};
+
+// Thread-safe map from FileId to a small value. Keys and values live in
+// flat open-addressing tables (no per-entry allocation), split into shards
+// with their own lock so concurrent walkers rarely contend.
+template <typename Value>
+class FileIdMap {
+public:
+    // Adds id -> value and returns true if id was not in the map yet;
+    // otherwise leaves the map unchanged and, if existing is given, stores
+    // the value already mapped to id there
+    bool insert(const FileId& id, const Value& value, Value* existing = nullptr) {
+        const std::size_t hash = FileIdHash{}(id);
+        Shard& shard = m_shards[hash % kShards];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.insert(id, value, hash / kShards, existing);
+    }
+
+    std::size_t size() const {
+        std::size_t total = 0;
+        for (const auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += shard.count;
+        }
+        return total;
+    }
+
+private:
+    static constexpr std::size_t kShards = 64;
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::vector<FileId> slots;
+        std::vector<Value> values;
+        std::vector<bool> used;
+        std::size_t count = 0;
+
+        bool insert(const FileId& id, const Value& value, std::size_t hash, Value* existing) {
+            if ((count + 1) * 2 > slots.size()) grow();
+            std::size_t mask = slots.size() - 1;
+            for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+                if (!used[i]) {
+                    used[i] = true;
+                    slots[i] = id;
+                    values[i] = value;
+                    ++count;
+                    return true;
+                }
+                if (slots[i] == id) {
+                    if (existing) *existing = values[i];
+                    return false;
+                }
+            }
+        }
+
+        void grow() {
+            std::vector<FileId> oldSlots = std::move(slots);
+            std::vector<Value> oldValues = std::move(values);
+            std::vector<bool> oldUsed = std::move(used);
+            const std::size_t capacity = oldSlots.empty() ? 16 : oldSlots.size() * 2;
+            slots.assign(capacity, FileId{});
+            values.assign(capacity, Value{});
+            used.assign(capacity, false);
+            count = 0;
+            for (std::size_t i = 0; i < oldSlots.size(); ++i) {
+                if (oldUsed[i]) insert(oldSlots[i], oldValues[i], FileIdHash{}(oldSlots[i]) / kShards, nullptr);
+            }
+        }
+    };
+
+    std::array<Shard, kShards> m_shards;
+};
+
+// Thread-safe "seen" set of FileIds
+class FileIdSet {
+public:
+    // Returns true if id was not in the set yet
+    bool insert(const FileId& id) { return m_map.insert(id, Empty{}); }
+
+    std::size_t size() const { return m_map.size(); }
+
+private:
+    struct Empty {};
+    FileIdMap<Empty> m_map;
+};
+
+#endif
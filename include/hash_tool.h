@@ -1,20 +1,82 @@
 #ifndef HASH_TOOL_H
 #define HASH_TOOL_H
 
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <string>
+#include <vector>
 
 namespace fs = std::filesystem;
 
+class ProgressMeter;
+
+// Read buffer sizing for hashFile: files larger than one buffer are hashed
+// through a read-ahead pipeline of kHashPipelineDepth buffers
+constexpr std::size_t kDefaultHashBufferSize = 1024 * 1024;
+constexpr std::size_t kMinHashBufferSize = 4096;
+constexpr std::size_t kHashPipelineDepth = 3;
+
+// Quick fingerprint sampling: kQuickSampleBlocks blocks of kQuickBlockSize
+// bytes at fixed offsets spread evenly from the start to the end of the file
+constexpr std::size_t kQuickSampleBlocks = 16;
+constexpr std::size_t kQuickBlockSize = 64 * 1024;
+
 struct HashCommand {
     std::string targetPath;
-    bool recursive;
+    bool recursive = false;
+    bool check = false;
+    bool failFast = false;
+    bool quick = false;
+    unsigned jobs = 0;
+    std::size_t bufferSize = kDefaultHashBufferSize;
+    bool progress = false;
 
     void run() const;
 };
 
+// One "<hex digest>  <path>" line of a sha256sum-format manifest
+struct ManifestEntry {
+    std::string expectedHash;
+    fs::path path;
+    std::size_t lineNumber;
+};
+
+enum class CheckStatus {
+    Ok,
+    Failed,
+    Missing,
+    Skipped
+};
+
+struct CheckResult {
+    ManifestEntry entry;
+    CheckStatus status;
+};
+
+// Exit statuses returned by checkManifest
+constexpr int kCheckAllOk = 0;
+constexpr int kCheckMismatch = 1;
+constexpr int kCheckManifestError = 2;
+
 // Hash tool helper functions
-std::string hashFile(const fs::path& filePath, bool& success);
-void printDirectoryHashes(const fs::path& dirPath, bool recursive, int indentLevel);
+std::string hashFile(const fs::path& filePath, bool& success, std::size_t bufferSize = kDefaultHashBufferSize,
+                     ProgressMeter* progress = nullptr);
+void printDirectoryHashes(const fs::path& dirPath, bool recursive, int indentLevel,
+                          std::size_t bufferSize = kDefaultHashBufferSize, bool quick = false,
+                          ProgressMeter* progress = nullptr);
+
+// Sampled fingerprint: SHA-256 over the file size and a fixed set of blocks.
+// Detects most changes cheaply but does NOT cover the whole file contents.
+std::string quickFingerprint(const fs::path& filePath, bool& success);
+std::vector<std::uintmax_t> quickSampleOffsets(std::uintmax_t fileSize);
+
+// Manifest verification helper functions
+bool parseManifestLine(const std::string& line, std::size_t lineNumber, ManifestEntry& entry);
+std::vector<CheckResult> verifyManifestEntries(const std::vector<ManifestEntry>& entries, unsigned jobs, bool failFast,
+                                               std::size_t bufferSize = kDefaultHashBufferSize,
+                                               ProgressMeter* progress = nullptr);
+int checkManifest(const fs::path& manifestPath, unsigned jobs, bool failFast,
+                  std::size_t bufferSize = kDefaultHashBufferSize, ProgressMeter* progress = nullptr);
 
-#endif
\ No newline at end of file
+#endif
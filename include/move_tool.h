@@ -1,6 +1,8 @@
 #ifndef MOVE_TOOL_H
 #define MOVE_TOOL_H
 
+#include "copy_tool.h"
+
 #include <filesystem>
 #include <string>
 
@@ -11,6 +13,8 @@ struct MoveCommand {
     std::string destinationPath;
     bool force = false;
     bool recursive = false;
+    std::string sparse = "auto";
+    bool progress = false;
 
     void run() const;
 };
@@ -23,5 +27,14 @@ bool moveRecursive(
     bool recursive,
     std::string& errorMessage
 );
+bool moveRecursive(
+    const fs::path& source,
+    const fs::path& destination,
+    bool force,
+    bool recursive,
+    SparseMode sparse,
+    std::string& errorMessage,
+    ProgressMeter* progress = nullptr
+);
 
 #endif
\ No newline at end of file
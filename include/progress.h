@@ -0,0 +1,231 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+// How often the progress line is redrawn on a terminal, and how often a new
+// line is logged when stderr is redirected
+constexpr std::chrono::milliseconds kProgressInterval{500};
+constexpr std::chrono::milliseconds kProgressLogInterval{5000};
+
+// Bytes progress must stall for before the line says so
+constexpr std::chrono::seconds kProgressStallTime{5};
+
+// Counters of a running operation at one instant
+struct ProgressSnapshot {
+    std::uint64_t files = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t errors = 0;
+    std::uint64_t expectedFiles = 0;
+    std::uint64_t expectedBytes = 0;
+    bool totalsKnown = false;           // expected* will not grow any more
+};
+
+// "1.5 GiB" style size for progress lines
+inline std::string formatProgressBytes(double bytes) {
+    static const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB", "PiB"};
+    int unit = 0;
+    while (bytes >= 1024.0 && unit < 5) {
+        bytes /= 1024.0;
+        ++unit;
+    }
+    char text[32];
+    std::snprintf(text, sizeof(text), unit == 0 ? "%.0f %s" : "%.1f %s", bytes, units[unit]);
+    return text;
+}
+
+// "1:02:03" / "2:03" style duration
+inline std::string formatProgressTime(double seconds) {
+    auto total = static_cast<std::uint64_t>(seconds + 0.5);
+    char text[32];
+    if (total >= 3600) {
+        std::snprintf(text, sizeof(text), "%llu:%02llu:%02llu", static_cast<unsigned long long>(total / 3600),
+                      static_cast<unsigned long long>(total / 60 % 60), static_cast<unsigned long long>(total % 60));
+    } else {
+        std::snprintf(text, sizeof(text), "%llu:%02llu", static_cast<unsigned long long>(total / 60),
+                      static_cast<unsigned long long>(total % 60));
+    }
+    return text;
+}
+
+// One progress line: counts, percentage and ETA (once the totals are
+// known), the byte rate, and how long bytes have not moved if stalled
+inline std::string renderProgressLine(const std::string& verb, const ProgressSnapshot& s, double bytesPerSecond,
+                                      double stalledSeconds, const std::string& current) {
+    std::string line = verb + ": " + std::to_string(s.files);
+    if (s.totalsKnown) line += "/" + std::to_string(s.expectedFiles);
+    line += " files, " + formatProgressBytes(static_cast<double>(s.bytes));
+    if (s.totalsKnown && s.expectedBytes > 0) {
+        const double fraction = std::min(1.0, static_cast<double>(s.bytes) / static_cast<double>(s.expectedBytes));
+        char percent[16];
+        std::snprintf(percent, sizeof(percent), " (%.0f%%)", fraction * 100.0);
+        line += " of " + formatProgressBytes(static_cast<double>(s.expectedBytes)) + percent;
+    }
+    line += ", " + formatProgressBytes(bytesPerSecond) + "/s";
+    if (s.totalsKnown && bytesPerSecond > 0 && s.expectedBytes > s.bytes) {
+        line += ", ETA " + formatProgressTime(static_cast<double>(s.expectedBytes - s.bytes) / bytesPerSecond);
+    }
+    if (s.errors > 0) line += ", " + std::to_string(s.errors) + " error(s)";
+    if (stalledSeconds >= static_cast<double>(kProgressStallTime.count())) {
+        line += ", no progress for " + formatProgressTime(stalledSeconds);
+    }
+    if (!current.empty()) line += " - " + current;
+    return line;
+}
+
+// Progress reporting for long copy / move / hash runs. Workers bump relaxed
+// atomic counters (and publish the current file with a try_lock, so they
+// never wait on the reporter); a reporter thread samples them at a fixed
+// interval and draws the line on stderr. Commands hold a null pointer when
+// --progress is off, so the disabled cost is one branch per update.
+class ProgressMeter {
+public:
+    explicit ProgressMeter(std::string verb, std::ostream& out = std::cerr)
+        : m_verb(std::move(verb)), m_out(out) {
+#if !defined(_WIN32)
+        m_interactive = ::isatty(STDERR_FILENO) == 1 && &out == &std::cerr;
+#endif
+    }
+
+    ~ProgressMeter() { stop(); }
+
+    ProgressMeter(const ProgressMeter&) = delete;
+    ProgressMeter& operator=(const ProgressMeter&) = delete;
+
+    void start() {
+        if (m_reporter.joinable()) return;
+        m_started = Clock::now();
+        m_reporter = std::thread([this]() { reportLoop(); });
+    }
+
+    // Stop the reporter and print the final totals
+    void stop() {
+        if (!m_reporter.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(m_stopMutex);
+            m_stopping = true;
+        }
+        m_stopCv.notify_all();
+        m_reporter.join();
+
+        const double elapsed = std::chrono::duration<double>(Clock::now() - m_started).count();
+        const ProgressSnapshot s = snapshot();
+        std::string line = m_verb + ": " + std::to_string(s.files) + " files, " +
+                           formatProgressBytes(static_cast<double>(s.bytes)) + " in " + formatProgressTime(elapsed);
+        if (elapsed > 0) line += " (" + formatProgressBytes(static_cast<double>(s.bytes) / elapsed) + "/s)";
+        if (s.errors > 0) line += ", " + std::to_string(s.errors) + " error(s)";
+        draw(line);
+        if (m_interactive) m_out << "\n";
+        m_out.flush();
+    }
+
+    // Worker-side updates
+    void addFiles(std::uint64_t n = 1) { m_files.fetch_add(n, std::memory_order_relaxed); }
+    void addBytes(std::uint64_t n) { m_bytes.fetch_add(n, std::memory_order_relaxed); }
+    void addError() { m_errors.fetch_add(1, std::memory_order_relaxed); }
+
+    // Work discovered so far; call totalsKnown() once nothing more will be
+    // added, which enables the percentage and ETA
+    void expect(std::uint64_t files, std::uint64_t bytes) {
+        m_expectedFiles.fetch_add(files, std::memory_order_relaxed);
+        m_expectedBytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    void totalsKnown() { m_totalsKnown.store(true, std::memory_order_release); }
+
+    // Skipped if the reporter is reading it right now
+    void setCurrent(const std::filesystem::path& path) {
+        std::unique_lock<std::mutex> lock(m_currentMutex, std::try_to_lock);
+        if (lock.owns_lock()) m_current = path.string();
+    }
+
+    ProgressSnapshot snapshot() const {
+        ProgressSnapshot s;
+        s.totalsKnown = m_totalsKnown.load(std::memory_order_acquire);
+        s.files = m_files.load(std::memory_order_relaxed);
+        s.bytes = m_bytes.load(std::memory_order_relaxed);
+        s.errors = m_errors.load(std::memory_order_relaxed);
+        s.expectedFiles = m_expectedFiles.load(std::memory_order_relaxed);
+        s.expectedBytes = m_expectedBytes.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void reportLoop() {
+        const auto interval = m_interactive ? kProgressInterval : kProgressLogInterval;
+        auto lastTick = m_started;
+        auto lastMove = m_started;
+        std::uint64_t lastBytes = 0;
+        double rate = 0;
+
+        std::unique_lock<std::mutex> lock(m_stopMutex);
+        while (!m_stopCv.wait_for(lock, interval, [this]() { return m_stopping; })) {
+            const auto now = Clock::now();
+            const ProgressSnapshot s = snapshot();
+            const double dt = std::chrono::duration<double>(now - lastTick).count();
+
+            // Smoothed rate so the ETA does not jump with every sample
+            const double instant = dt > 0 ? static_cast<double>(s.bytes - lastBytes) / dt : 0;
+            rate = lastTick == m_started ? instant : 0.7 * rate + 0.3 * instant;
+            if (s.bytes != lastBytes) lastMove = now;
+            lastBytes = s.bytes;
+            lastTick = now;
+
+            std::string current;
+            {
+                std::lock_guard<std::mutex> currentLock(m_currentMutex);
+                current = m_current;
+            }
+            draw(renderProgressLine(m_verb, s, rate, std::chrono::duration<double>(now - lastMove).count(), current));
+        }
+    }
+
+    void draw(const std::string& line) {
+        if (m_interactive) {
+            m_out << "\r" << line << "\033[K";
+        } else {
+            m_out << line << "\n";
+        }
+        m_out.flush();
+    }
+
+    std::string m_verb;
+    std::ostream& m_out;
+    bool m_interactive = false;
+
+    // Each counter on its own cache line so workers bumping different
+    // counters do not share one
+    alignas(64) std::atomic<std::uint64_t> m_files{0};
+    alignas(64) std::atomic<std::uint64_t> m_bytes{0};
+    alignas(64) std::atomic<std::uint64_t> m_errors{0};
+    alignas(64) std::atomic<std::uint64_t> m_expectedFiles{0};
+    std::atomic<std::uint64_t> m_expectedBytes{0};
+    std::atomic<bool> m_totalsKnown{false};
+
+    std::mutex m_currentMutex;
+    std::string m_current;
+
+    std::mutex m_stopMutex;
+    std::condition_variable m_stopCv;
+    bool m_stopping = false;
+    Clock::time_point m_started;
+    std::thread m_reporter;
+};
+
+#endif
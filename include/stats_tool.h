@@ -3,39 +3,223 @@
 
 #include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace fs = std::filesystem;
 
 struct StatsCommand {
     std::string targetPath;
+    unsigned jobs = 1;
+    std::size_t topN = 0;
+    bool histogram = false;
+    bool byExtension = false;
+    bool oneFileSystem = false;
+    std::string format = "text";
+    bool sorted = false;
+    bool lines = false;
+    bool words = false;
+    bool estimate = false;
+    std::size_t estimateSamples = 0;
+    double estimateSeconds = 5.0;
 
     void run() const;
 };
 
-struct FileSummary {
-    std::string filename;
-    std::string extension;
+// One immediate file, viewed from a FileListing (valid while it lives)
+struct FileEntry {
+    std::string_view filename;
+    std::string_view extension;
     std::uintmax_t size;
+    std::uintmax_t lines;
+    std::uintmax_t words;
 };
 
-struct SubdirSummary {
-    std::string dirpath;
+// One immediate subdirectory with recursive totals, viewed from a SubdirListing
+struct SubdirEntry {
+    std::string_view dirpath;
     std::uintmax_t totalSize;
     std::size_t fileCount;
+    std::uintmax_t allocatedSize;
+    std::uintmax_t lineCount;
 };
 
+// Append-only storage for names: all bytes live in one buffer and entries
+// refer to them by offset and length, so there is no allocation per name
+class StringArena {
+public:
+    std::uint64_t add(std::string_view text) {
+        const std::uint64_t offset = m_bytes.size();
+        m_bytes.append(text);
+        return offset;
+    }
+    std::string_view view(std::uint64_t offset, std::uint32_t length) const {
+        return std::string_view(m_bytes).substr(offset, length);
+    }
+    std::size_t bytes() const { return m_bytes.size(); }
+
+private:
+    std::string m_bytes;
+};
+
+// Immediate files of a directory as structure-of-arrays columns: names in
+// an arena, extensions interned to small ids, and sorting done on a 32-bit
+// index permutation instead of moving entries. About 44 bytes per file plus
+// the name itself.
+class FileListing {
+public:
+    void add(std::string_view filename, std::string_view extension, std::uintmax_t size,
+             std::uintmax_t lines = 0, std::uintmax_t words = 0);
+    void sort();   // by extension, then filename
+
+    std::size_t size() const { return m_order.size(); }
+    bool empty() const { return m_order.empty(); }
+    FileEntry operator[](std::size_t i) const;   // i-th entry in listing order
+
+private:
+    StringArena m_names;
+    std::vector<std::uint64_t> m_nameOffsets;
+    std::vector<std::uint32_t> m_nameLengths;
+    std::vector<std::uint32_t> m_extensionIds;
+    std::vector<std::uintmax_t> m_sizes;
+    std::vector<std::uintmax_t> m_lines;
+    std::vector<std::uintmax_t> m_words;
+    std::vector<std::uint32_t> m_order;
+    std::vector<std::string> m_extensions;                         // id -> extension
+    std::unordered_map<std::string, std::uint32_t> m_extensionIndex;
+};
+
+// Immediate subdirectories in the same layout; totals are filled in by index
+class SubdirListing {
+public:
+    std::size_t add(std::string_view dirpath);
+    void setTotals(std::size_t index, std::uintmax_t totalSize, std::size_t fileCount,
+                   std::uintmax_t allocatedSize, std::uintmax_t lineCount);
+    void sort();   // by path
+
+    std::size_t size() const { return m_order.size(); }
+    bool empty() const { return m_order.empty(); }
+    SubdirEntry operator[](std::size_t i) const;
+
+private:
+    StringArena m_paths;
+    std::vector<std::uint64_t> m_pathOffsets;
+    std::vector<std::uint32_t> m_pathLengths;
+    std::vector<std::uintmax_t> m_totalSizes;
+    std::vector<std::size_t> m_fileCounts;
+    std::vector<std::uintmax_t> m_allocatedSizes;
+    std::vector<std::uintmax_t> m_lineCounts;
+    std::vector<std::uint32_t> m_order;
+};
+
+// Sizes are apparent (st_size) and allocated (st_blocks) bytes. Files with
+// several hard links are counted once; later paths only bump duplicateLinks.
 struct DirectoryTotals {
     std::size_t totalFiles;
     std::size_t totalDirs;
     std::uintmax_t totalSize;
+    std::uintmax_t allocatedSize = 0;
+    std::size_t duplicateLinks = 0;
+    std::uintmax_t totalLines = 0;
+    std::uintmax_t totalWords = 0;
+};
+
+// A file or directory ranked by (recursive) size
+struct SizeEntry {
+    std::string path;
+    std::uintmax_t size;
+};
+
+// Files whose size (or age in seconds) falls in [lower, upper)
+struct HistogramBucket {
+    std::uintmax_t lower;
+    std::uintmax_t upper;
+    std::uintmax_t fileCount;
+    std::uintmax_t totalSize;
+};
+
+struct ExtensionSummary {
+    std::string extension;
+    std::uintmax_t fileCount;
+    std::uintmax_t totalSize;
+    std::uintmax_t lines = 0;
+    std::uintmax_t words = 0;
+};
+
+// Newline and word counts. A word is a maximal run of bytes that are not
+// space, \t, \n, \v, \f or \r (the POSIX wc definition).
+struct TextCounts {
+    std::uintmax_t lines = 0;
+    std::uintmax_t words = 0;
+    bool inWord = false;   // carried between buffers of the same file
+};
+
+// Which whole-tree summaries to gather during the walk
+struct StatsOptions {
+    unsigned jobs = 1;             // 0 = one per core
+    std::size_t topN = 0;          // largest files/directories to keep
+    bool histogram = false;        // size and modification-age histograms
+    bool byExtension = false;      // recursive per-extension totals
+    bool oneFileSystem = false;    // do not descend into other mounts
+    bool countLines = false;       // read files and count newlines
+    bool countWords = false;       // also count words (implies countLines)
 };
 
+// Everything the directory view prints, gathered in one traversal
+struct StatsReport {
+    DirectoryTotals totals;
+    FileListing files;
+    SubdirListing subdirs;
+
+    std::vector<SizeEntry> largestFiles;          // descending, at most topN
+    std::vector<SizeEntry> largestDirs;           // descending, at most topN
+    std::vector<HistogramBucket> sizeHistogram;   // power-of-two size buckets
+    std::vector<HistogramBucket> ageHistogram;    // age bounds in seconds
+    std::vector<ExtensionSummary> extensions;     // descending by total size
+};
+
+// Upper bounds (seconds) of the modification-age histogram buckets
+constexpr std::uintmax_t kAgeBucketBounds[] = {
+    60ull * 60 * 24,            // 1 day
+    60ull * 60 * 24 * 7,        // 1 week
+    60ull * 60 * 24 * 30,       // 1 month
+    60ull * 60 * 24 * 90,       // 3 months
+    60ull * 60 * 24 * 365,      // 1 year
+    60ull * 60 * 24 * 365 * 3,  // 3 years
+    UINTMAX_MAX
+};
+
+// Result of randomized descent sampling. Each sample walks one random
+// root-to-leaf path and yields an unbiased estimate of the tree totals
+// (Knuth's estimator); margins are 95% confidence half-widths over samples.
+struct StatsEstimate {
+    std::size_t samples = 0;
+    std::size_t directoriesRead = 0;
+    double files = 0;
+    double dirs = 0;
+    double bytes = 0;
+    double filesMargin = 0;
+    double dirsMargin = 0;
+    double bytesMargin = 0;
+    bool exact = false;               // every directory was read; no sampling error
+};
+
+// Called with the running estimate roughly once per second
+using EstimateProgress = std::function<void(const StatsEstimate&)>;
+
 // Stats tool helper functions
+StatsReport collectDirectoryStats(const std::string& directory, const StatsOptions& options = {});
+void countText(const unsigned char* data, std::size_t length, bool countWords, TextCounts& counts);
+bool countFileText(const fs::path& path, bool countWords, TextCounts& counts);
+StatsEstimate estimateDirectoryStats(const std::string& directory, std::size_t maxSamples, double maxSeconds,
+                                    std::uint64_t seed = 0, const EstimateProgress& progress = {});
+DirectoryTotals streamDirectoryStats(const std::string& directory, const StatsOptions& options,
+                                     std::ostream& out, bool sorted = false);
 DirectoryTotals computeDirectoryTotals(const std::string& directory);
-std::vector<FileSummary> listImmediateFiles(const std::string& directory);
-std::vector<SubdirSummary> listImmediateSubdirs(const std::string& directory);
 std::string formatSize(std::uintmax_t bytes);
 std::string formatFileTime(const fs::file_time_type& ft);
 
@@ -1,19 +1,159 @@
 #ifndef TREE_TOOL_H
 #define TREE_TOOL_H
 
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace fs = std::filesystem;
 
+// Output is assembled in memory and written in chunks of this size
+constexpr std::size_t kTreeOutputBufferSize = 256 * 1024;
+
+// --prefetch: directory listings queued, in flight or waiting, per thread
+constexpr std::size_t kTreePrefetchListingsPerThread = 16;
+
 struct TreeCommand {
     fs::path path;
     bool dirsOnly = false;
+    std::size_t maxDepth = 0;          // 0 = unlimited
+    std::size_t maxEntriesPerDir = 0;  // 0 = unlimited
+    bool du = false;
+    std::uintmax_t minSize = 0;
+    unsigned jobs = 1;
+    std::string includePattern;
+    std::string excludePattern;
+    bool prune = false;
+    std::string sort = "none";
+    bool dirsFirst = false;
+    unsigned prefetch = 0;
 
     void run() const;
 };
 
+// Entry order within a directory. None keeps readdir order; size puts the
+// largest first and mtime the newest first, with ties broken by name.
+enum class TreeSort { None, Name, Natural, Size, Mtime };
+
+struct TreeOptions {
+    bool dirsOnly = false;
+    std::size_t maxDepth = 0;          // levels below the root to show (0 = all)
+    std::size_t maxEntriesPerDir = 0;  // entries shown per directory (0 = all)
+    std::uintmax_t minSize = 0;        // --du: hide entries smaller than this
+    std::string includePattern;        // -P: files shown must match ("a|b" alternatives)
+    std::string excludePattern;        // -I: files and directories matching are hidden
+    bool prune = false;                // hide directories without matching files
+    TreeSort sort = TreeSort::None;
+    bool dirsFirst = false;            // list directories before files
+    unsigned prefetch = 0;             // threads listing directories ahead (0 = off)
+};
+
+// One entry of a tree --du listing with its recursive totals. Regular files
+// count as one file; hard-linked files add to the totals only once.
+struct DuNode {
+    std::string name;
+    bool isDir = false;
+    std::uintmax_t size = 0;
+    std::uintmax_t files = 0;
+    std::int64_t mtime = 0;                          // seconds; set for files, and dirs when sorting by mtime
+    std::vector<std::unique_ptr<DuNode>> children;   // directory order
+};
+
+// Lists directories on background threads ahead of the renderer. The
+// renderer requests the subdirectories it will open next, in output
+// order, and take() hands back a finished listing (waiting if one is in
+// flight, reading inline if it was not started). At most maxListings are
+// queued, running or waiting at once, which bounds memory.
+class DirectoryPrefetcher {
+public:
+    DirectoryPrefetcher(unsigned threads, std::size_t maxListings);
+    ~DirectoryPrefetcher();
+
+    void request(const std::vector<fs::path>& directories);
+    std::vector<fs::directory_entry> take(const fs::path& directory);
+    // Drop listings that were requested but will not be taken
+    void discard(const std::vector<fs::path>& directories);
+
+private:
+    struct Slot {
+        enum State { Queued, Running, Ready } state = Queued;
+        bool discarded = false;
+        std::vector<fs::directory_entry> entries;
+        std::exception_ptr error;
+    };
+
+    static std::vector<fs::directory_entry> readListing(const fs::path& directory);
+    void workerLoop();
+
+    const std::size_t m_maxListings;
+    std::mutex m_mutex;
+    std::condition_variable m_workCv;
+    std::condition_variable m_readyCv;
+    std::unordered_map<fs::path::string_type, Slot> m_slots;
+    std::deque<fs::path::string_type> m_queue;
+    bool m_stop = false;
+    std::vector<std::thread> m_workers;
+};
+
+// Depth-first tree printer. Lines are built in one output buffer and the
+// connector prefix is a single string that grows and shrinks with the
+// depth, so printing a line does not allocate. Directories beyond
+// maxDepth are not opened; entries beyond maxEntriesPerDir are counted
+// but not kept, and summarized as "... N more". With prune, directories
+// are shown only if their subtree holds a file passing the patterns; the
+// answers still ahead of the renderer are cached, so no subtree is scanned
+// twice.
+class TreeRenderer {
+public:
+    TreeRenderer(std::ostream& out, const TreeOptions& options);
+    ~TreeRenderer();
+
+    // Print the children of directory below the current prefix
+    void renderChildren(const fs::path& directory, std::size_t depth = 1);
+    void setPrefix(std::string_view prefix) { m_prefix.assign(prefix); }
+    void renderDu(const DuNode& root);
+    void writeLine(std::string_view text);
+    void flush();
+
+    // --prune answers cached for directories not rendered yet
+    std::size_t pruneCacheSize() const { return m_pruneCache.size(); }
+
+private:
+    bool fileMatches(std::string_view name) const;
+    bool hasMatchingFile(const fs::path& directory);
+    bool isVisible(const fs::directory_entry& entry);
+    void forgetPruneSubtree(const fs::path& directory);
+    void sortEntries(std::vector<fs::directory_entry>& entries) const;
+    std::vector<fs::path> prefetchSubdirs(const std::vector<fs::directory_entry>& entries, std::size_t depth);
+    void renderEntry(const fs::directory_entry& entry, bool last, std::size_t depth);
+    void writeEntry(bool last, std::string_view name);
+    void renderDuChildren(const DuNode& directory);
+
+    std::ostream& m_out;
+    TreeOptions m_options;
+    std::string m_buffer;
+    std::string m_prefix;
+    std::unique_ptr<DirectoryPrefetcher> m_prefetcher;
+    std::unordered_map<fs::path::string_type, bool> m_pruneCache;   // --prune: directory -> holds a match
+};
+
 // Tree tool helper functions
+bool globMatch(std::string_view pattern, std::string_view name);
+bool globMatchAny(std::string_view patterns, std::string_view name);
+bool naturalLess(std::string_view a, std::string_view b);
+bool parseTreeSort(const std::string& name, TreeSort& sort);
+std::unique_ptr<DuNode> buildDuTree(const fs::path& root, const TreeOptions& options, unsigned jobs = 1);
 void printTreeRecursive( 
     const fs::path& path, 
     const std::string& prefix, 
@@ -21,4 +161,4 @@ void printTreeRecursive(
     bool dirsOnly
 );
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,108 @@
+#ifndef WORK_STEALING_H
+#define WORK_STEALING_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Work-stealing task pool for tree walks. Each worker owns a deque: it pushes
+// and pops its own tasks LIFO (depth-first, cache friendly) and steals FIFO
+// from other workers when it runs dry, so large subtrees are split up while
+// small ones stay on one thread. Tasks may push further tasks while running.
+// The thread calling run() acts as worker 0, so a one-worker pool runs
+// everything inline without spawning threads.
+template <typename Task>
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned workers)
+        : m_queues(std::max(1u, workers)) {
+        for (auto& q : m_queues) q = std::make_unique<Queue>();
+    }
+
+    unsigned size() const { return static_cast<unsigned>(m_queues.size()); }
+
+    // Queue a task on a worker's deque (call with the current worker id from
+    // inside a task, or any id before run())
+    void push(unsigned worker, Task task) {
+        m_pending.fetch_add(1, std::memory_order_relaxed);
+        Queue& q = *m_queues[worker % m_queues.size()];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.tasks.push_back(std::move(task));
+    }
+
+    // Run until every queued task, and every task they push, has finished.
+    // fn is called as fn(Task&, unsigned workerId).
+    template <typename Fn>
+    void run(Fn&& fn) {
+        std::vector<std::thread> threads;
+        threads.reserve(m_queues.size() - 1);
+        for (unsigned id = 1; id < m_queues.size(); ++id) {
+            threads.emplace_back([this, &fn, id]() { workerLoop(id, fn); });
+        }
+        workerLoop(0, fn);
+        for (auto& t : threads) t.join();
+    }
+
+private:
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool popLocal(unsigned id, Task& out) {
+        Queue& q = *m_queues[id];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) return false;
+        out = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(unsigned id, Task& out) {
+        const size_t n = m_queues.size();
+        for (size_t k = 1; k < n; ++k) {
+            Queue& victim = *m_queues[(id + k) % n];
+            std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+            if (!lock.owns_lock() || victim.tasks.empty()) continue;
+            out = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    template <typename Fn>
+    void workerLoop(unsigned id, Fn& fn) {
+        unsigned idleRounds = 0;
+        Task task;
+        while (true) {
+            if (popLocal(id, task) || steal(id, task)) {
+                idleRounds = 0;
+                fn(task, id);
+                m_pending.fetch_sub(1, std::memory_order_acq_rel);
+                continue;
+            }
+
+            if (m_pending.load(std::memory_order_acquire) == 0) return;
+
+            // Other workers are still running tasks that may spawn more work
+            if (++idleRounds < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::atomic<std::size_t> m_pending{0};
+};
+
+#endif
@@ -1,54 +1,1315 @@
 #include "../include/copy_tool.h"
+#include "../include/aligned_buffer.h"
+#include "../include/file_identity.h"
+#include "../include/progress.h"
+#include "../include/sha256.h"
+#include "../include/work_stealing.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
 
 namespace fs = std::filesystem;
 
+bool parseReflinkMode(const std::string& name, ReflinkMode& mode) {
+    if (name == "auto") mode = ReflinkMode::Auto;
+    else if (name == "always") mode = ReflinkMode::Always;
+    else if (name == "never") mode = ReflinkMode::Never;
+    else return false;
+    return true;
+}
+
+bool parseSparseMode(const std::string& name, SparseMode& mode) {
+    if (name == "auto") mode = SparseMode::Auto;
+    else if (name == "always") mode = SparseMode::Always;
+    else if (name == "never") mode = SparseMode::Never;
+    else return false;
+    return true;
+}
+
+const char* copyStrategyName(CopyStrategy strategy) {
+    switch (strategy) {
+        case CopyStrategy::Reflink: return "reflink";
+        case CopyStrategy::Sparse: return "sparse";
+        case CopyStrategy::CopyFileRange: return "copy_file_range";
+        case CopyStrategy::Sendfile: return "sendfile";
+        case CopyStrategy::ReadWrite: return "read/write";
+        case CopyStrategy::Delta: return "delta";
+        case CopyStrategy::Direct: return "direct";
+        case CopyStrategy::Uncached: return "uncached read/write";
+        case CopyStrategy::None: break;
+    }
+    return "none";
+}
+
+#if !defined(_WIN32)
+// Closes the descriptor when it goes out of scope
+struct ScopedFd {
+    int fd = -1;
+    explicit ScopedFd(int f) : fd(f) {}
+    ~ScopedFd() { if (fd >= 0) ::close(fd); }
+    ScopedFd(const ScopedFd&) = delete;
+    ScopedFd& operator=(const ScopedFd&) = delete;
+};
+
+// Result of one offloaded strategy: Unsupported means nothing was written
+// and the next strategy may be tried
+enum class Offload { Done, Unsupported, Failed };
+
+static std::error_code lastError() {
+    return std::error_code(errno, std::generic_category());
+}
+
+// Errors that mean "this mechanism does not work for these two files"
+static bool isUnsupported(int err) {
+    return err == ENOSYS || err == EOPNOTSUPP || err == ENOTSUP || err == EXDEV ||
+           err == EINVAL || err == ENOTTY || err == EBADF;
+}
+
+static Offload tryReflink(int in, int out, std::error_code& ec) {
+#if defined(__linux__) && defined(FICLONE)
+    if (::ioctl(out, FICLONE, in) == 0) return Offload::Done;
+    ec = lastError();
+    return isUnsupported(errno) ? Offload::Unsupported : Offload::Failed;
+#else
+    (void)in;
+    (void)out;
+    ec = std::make_error_code(std::errc::operation_not_supported);
+    return Offload::Unsupported;
+#endif
+}
+
+// Largest request per offloaded syscall: smaller with --progress so the
+// byte counter keeps moving through a single huge file
+static std::uintmax_t offloadChunk(const ProgressMeter* progress) {
+    return progress ? 64u << 20 : 1u << 30;
+}
+
+// In-kernel copy of size bytes; server-side on NFS 4.2 and CIFS
+static Offload tryCopyFileRange(int in, int out, std::uintmax_t size, ProgressMeter* progress, std::error_code& ec) {
+#if defined(__linux__)
+    std::uintmax_t copied = 0;
+    while (copied < size) {
+        const std::size_t chunk = static_cast<std::size_t>(std::min(size - copied, offloadChunk(progress)));
+        ssize_t n = ::copy_file_range(in, nullptr, out, nullptr, chunk, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ec = lastError();
+            return copied == 0 && isUnsupported(errno) ? Offload::Unsupported : Offload::Failed;
+        }
+        if (n == 0) {
+            // Some pseudo filesystems report a size but copy nothing
+            if (copied == 0) return Offload::Unsupported;
+            break;   // file shrank
+        }
+        copied += static_cast<std::uintmax_t>(n);
+        if (progress) progress->addBytes(static_cast<std::uint64_t>(n));
+    }
+    return Offload::Done;
+#else
+    (void)in;
+    (void)out;
+    (void)size;
+    (void)progress;
+    ec = std::make_error_code(std::errc::operation_not_supported);
+    return Offload::Unsupported;
+#endif
+}
+
+// Kernel-side copy through the page cache, without user-space buffers
+static Offload trySendfile(int in, int out, std::uintmax_t size, ProgressMeter* progress, std::error_code& ec) {
+#if defined(__linux__)
+    std::uintmax_t copied = 0;
+    while (copied < size) {
+        const std::size_t chunk = static_cast<std::size_t>(std::min(size - copied, offloadChunk(progress)));
+        ssize_t n = ::sendfile(out, in, nullptr, chunk);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ec = lastError();
+            return copied == 0 && isUnsupported(errno) ? Offload::Unsupported : Offload::Failed;
+        }
+        if (n == 0) {
+            if (copied == 0) return Offload::Unsupported;
+            break;
+        }
+        copied += static_cast<std::uintmax_t>(n);
+        if (progress) progress->addBytes(static_cast<std::uint64_t>(n));
+    }
+    return Offload::Done;
+#else
+    (void)in;
+    (void)out;
+    (void)size;
+    (void)progress;
+    ec = std::make_error_code(std::errc::operation_not_supported);
+    return Offload::Unsupported;
+#endif
+}
+
+static bool writeAll(int fd, const std::uint8_t* data, std::size_t length, std::error_code& ec) {
+    while (length > 0) {
+        ssize_t n = ::write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ec = lastError();
+            return false;
+        }
+        data += n;
+        length -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+static bool isZeroBlock(const std::uint8_t* data, std::size_t length) {
+    return length == 0 || (data[0] == 0 && std::memcmp(data, data + 1, length - 1) == 0);
+}
+
+// --sparse=always turns all-zero blocks of this size into holes
+static constexpr std::size_t kSparseBlockSize = AlignedBuffer::kAlignment;
+
+// Write data at offset, leaving all-zero blocks as holes when skipZeros is
+// set (out was truncated, so unwritten ranges read back as zeros)
+static bool writeSparse(int out, const std::uint8_t* data, std::size_t length, std::uintmax_t offset,
+                        bool skipZeros, std::error_code& ec) {
+    auto zeroAt = [&](std::size_t at) {
+        return isZeroBlock(data + at, std::min(kSparseBlockSize, length - at));
+    };
+    std::size_t pos = 0;
+    while (pos < length) {
+        std::size_t end = length;
+        if (skipZeros) {
+            while (pos < length && zeroAt(pos)) pos = std::min(pos + kSparseBlockSize, length);
+            end = pos;
+            while (end < length && !zeroAt(end)) end = std::min(end + kSparseBlockSize, length);
+        }
+        while (pos < end) {
+            ssize_t n = ::pwrite(out, data + pos, end - pos, static_cast<off_t>(offset + pos));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                ec = lastError();
+                return false;
+            }
+            pos += static_cast<std::size_t>(n);
+        }
+    }
+    return true;
+}
+
+// Feed length zero bytes (the contents of a hole) to a digest
+static void hashZeros(SHA256& digest, std::uintmax_t length) {
+    static const std::uint8_t zeros[64 * 1024] = {};
+    while (length > 0) {
+        const std::size_t n = static_cast<std::size_t>(std::min<std::uintmax_t>(length, sizeof(zeros)));
+        digest.update(zeros, n);
+        length -= n;
+    }
+}
+
+// Copy only the data segments of in, so its holes stay holes in out; with
+// skipZeros, zero-filled blocks inside the data become holes too. Reports
+// Unsupported (before writing anything) where SEEK_DATA is unavailable.
+static Offload trySparseCopy(int in, int out, std::uintmax_t size, bool skipZeros, ProgressMeter* progress,
+                            SHA256* digest, std::error_code& ec) {
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    AlignedBuffer buffer(kCopyBufferSize);
+    std::uintmax_t pos = 0;
+    while (pos < size) {
+        off_t data = ::lseek(in, static_cast<off_t>(pos), SEEK_DATA);
+        if (data < 0) {
+            if (errno == ENXIO) break;   // only a hole is left
+            ec = lastError();
+            return pos == 0 && isUnsupported(errno) ? Offload::Unsupported : Offload::Failed;
+        }
+        off_t hole = ::lseek(in, data, SEEK_HOLE);
+        if (hole < 0) {
+            ec = lastError();
+            return Offload::Failed;
+        }
+        if (digest) hashZeros(*digest, static_cast<std::uintmax_t>(data) - pos);
+
+        for (std::uintmax_t at = static_cast<std::uintmax_t>(data); at < static_cast<std::uintmax_t>(hole);) {
+            const std::size_t want = static_cast<std::size_t>(
+                std::min<std::uintmax_t>(buffer.size(), static_cast<std::uintmax_t>(hole) - at));
+            ssize_t n = ::pread(in, buffer.data(), want, static_cast<off_t>(at));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                ec = lastError();
+                return Offload::Failed;
+            }
+            if (n == 0) break;   // file shrank
+            if (digest) digest->update(buffer.data(), static_cast<std::size_t>(n));
+            if (!writeSparse(out, buffer.data(), static_cast<std::size_t>(n), at, skipZeros, ec)) {
+                return Offload::Failed;
+            }
+            at += static_cast<std::uintmax_t>(n);
+            if (progress) progress->addBytes(static_cast<std::uint64_t>(n));
+        }
+        pos = static_cast<std::uintmax_t>(hole);
+    }
+    if (digest && pos < size) hashZeros(*digest, size - pos);
+
+    // Trailing holes are not written, so set the length explicitly
+    if (::ftruncate(out, static_cast<off_t>(size)) != 0) {
+        ec = lastError();
+        return Offload::Failed;
+    }
+    return Offload::Done;
+#else
+    (void)in;
+    (void)out;
+    (void)size;
+    (void)skipZeros;
+    (void)progress;
+    (void)digest;
+    ec = std::make_error_code(std::errc::operation_not_supported);
+    return Offload::Unsupported;
+#endif
+}
+
+// Copy from the current offsets until EOF through one aligned buffer
+static bool readWriteLoop(int in, int out, ProgressMeter* progress, SHA256* digest, std::error_code& ec) {
+    AlignedBuffer buffer(kCopyBufferSize);
+    while (true) {
+        ssize_t n = ::read(in, buffer.data(), buffer.size());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ec = lastError();
+            return false;
+        }
+        if (n == 0) return true;
+        if (digest) digest->update(buffer.data(), static_cast<std::size_t>(n));
+        if (!writeAll(out, buffer.data(), static_cast<std::size_t>(n), ec)) return false;
+        if (progress) progress->addBytes(static_cast<std::uint64_t>(n));
+    }
+}
+
+#if defined(O_DIRECT)
+// Turn O_DIRECT on or off for an open descriptor
+static bool setDirect(int fd, bool on) {
+    int flags = ::fcntl(fd, F_GETFL);
+    if (flags < 0) return false;
+    flags = on ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    return ::fcntl(fd, F_SETFL, flags) == 0;
+}
+
+// Fill data from an O_DIRECT descriptor. A partial block can only be the end
+// of the file, and reading on from its unaligned offset would fail, so it
+// ends the read. Returns the byte count or -1.
+static ssize_t readDirect(int fd, std::uint8_t* data, std::size_t length) {
+    std::size_t total = 0;
+    while (total < length) {
+        ssize_t n = ::read(fd, data + total, length - total);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        total += static_cast<std::size_t>(n);
+        if (total % AlignedBuffer::kAlignment != 0) break;
+    }
+    return static_cast<ssize_t>(total);
+}
+
+// Copy between two O_DIRECT descriptors: a reader thread fills the aligned
+// buffers while this thread writes the ones already read. The tail is
+// written as a zero-padded whole block and the file is then cut back to its
+// real length. Reports Unsupported if the first read or write is refused.
+static Offload directPipeline(int in, int out, ProgressMeter* progress, SHA256* digest, std::error_code& ec) {
+    struct Slot {
+        AlignedBuffer buffer;
+        std::size_t length = 0;
+        bool last = false;
+        int error = 0;
+    };
+
+    std::vector<Slot> slots(kDirectPipelineDepth);
+    for (auto& slot : slots) slot.buffer = AlignedBuffer(kDirectBufferSize);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::size_t filled = 0;
+    bool abort = false;
+
+    std::thread reader([&]() {
+        for (std::size_t index = 0;; ++index) {
+            bool stop;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() { return filled < slots.size(); });
+                stop = abort;
+            }
+
+            Slot& slot = slots[index % slots.size()];
+            ssize_t n = stop ? 0 : readDirect(in, slot.buffer.data(), slot.buffer.size());
+            slot.error = n < 0 ? errno : 0;
+            slot.length = n < 0 ? 0 : static_cast<std::size_t>(n);
+            slot.last = n < 0 || slot.length < slot.buffer.size();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++filled;
+            }
+            cv.notify_all();
+
+            if (slot.last) return;
+        }
+    });
+
+    // Every slot is consumed up to the last one, even after a failure, so
+    // the reader never waits on a buffer that will not be freed
+    Offload result = Offload::Done;
+    std::uintmax_t copied = 0;
+    for (std::size_t index = 0;; ++index) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return filled > 0; });
+        }
+
+        Slot& slot = slots[index % slots.size()];
+        if (result == Offload::Done && slot.error != 0) {
+            ec = std::error_code(slot.error, std::generic_category());
+            result = copied == 0 && slot.error == EINVAL ? Offload::Unsupported : Offload::Failed;
+        } else if (result == Offload::Done && slot.length > 0) {
+            const std::size_t padded = (slot.length + AlignedBuffer::kAlignment - 1) /
+                                       AlignedBuffer::kAlignment * AlignedBuffer::kAlignment;
+            std::memset(slot.buffer.data() + slot.length, 0, padded - slot.length);
+            if (writeAll(out, slot.buffer.data(), padded, ec)) {
+                if (digest) digest->update(slot.buffer.data(), slot.length);
+                if (progress) progress->addBytes(slot.length);
+                copied += slot.length;
+            } else {
+                result = copied == 0 && ec.value() == EINVAL ? Offload::Unsupported : Offload::Failed;
+            }
+        }
+        const bool last = slot.last;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --filled;
+            if (result != Offload::Done) abort = true;
+        }
+        cv.notify_all();
+
+        if (last) break;
+    }
+    reader.join();
+
+    if (result == Offload::Done && ::ftruncate(out, static_cast<off_t>(copied)) != 0) {
+        ec = lastError();
+        return Offload::Failed;
+    }
+    return result;
+}
+#endif
+
+// --direct copy with O_DIRECT on both descriptors, so neither file's data
+// passes through the page cache. Unsupported where the filesystem (or the
+// platform) does not offer O_DIRECT; the descriptors are left at offset 0
+// without O_DIRECT in that case.
+static Offload tryDirectCopy(int in, int out, ProgressMeter* progress, SHA256* digest, std::error_code& ec) {
+#if defined(O_DIRECT)
+    Offload result = Offload::Unsupported;
+    if (setDirect(in, true) && setDirect(out, true)) {
+        result = directPipeline(in, out, progress, digest, ec);
+    } else {
+        ec = lastError();
+        if (!isUnsupported(errno)) result = Offload::Failed;
+    }
+    setDirect(in, false);
+    setDirect(out, false);
+    if (result == Offload::Unsupported && (::lseek(in, 0, SEEK_SET) < 0 || ::lseek(out, 0, SEEK_SET) < 0 ||
+                                           ::ftruncate(out, 0) != 0)) {
+        ec = lastError();
+        return Offload::Failed;
+    }
+    return result;
+#else
+    (void)in;
+    (void)out;
+    (void)progress;
+    (void)digest;
+    ec = std::make_error_code(std::errc::operation_not_supported);
+    return Offload::Unsupported;
+#endif
+}
+
+// --direct without O_DIRECT: a read/write loop that starts writeback of each
+// chunk as soon as it is written, waits for it one chunk later and then
+// drops both files' cached pages for it, so the copy keeps only a couple of
+// chunks in the page cache instead of the whole file
+static bool uncachedLoop(int in, int out, ProgressMeter* progress, SHA256* digest, std::error_code& ec) {
+    AlignedBuffer buffer(kDirectBufferSize);
+    off_t offset = 0;
+    off_t previous = 0;
+    std::size_t previousLength = 0;
+    while (true) {
+        ssize_t n = ::read(in, buffer.data(), buffer.size());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ec = lastError();
+            return false;
+        }
+        if (n == 0) break;
+        const std::size_t length = static_cast<std::size_t>(n);
+        if (digest) digest->update(buffer.data(), length);
+        if (!writeAll(out, buffer.data(), length, ec)) return false;
+        if (progress) progress->addBytes(length);
+
+#if defined(__linux__)
+        ::sync_file_range(out, offset, static_cast<off_t>(length), SYNC_FILE_RANGE_WRITE);
+        if (previousLength > 0) {
+            ::sync_file_range(out, previous, static_cast<off_t>(previousLength),
+                              SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        }
+#endif
+#if defined(POSIX_FADV_DONTNEED)
+        if (previousLength > 0) ::posix_fadvise(out, previous, static_cast<off_t>(previousLength), POSIX_FADV_DONTNEED);
+        ::posix_fadvise(in, offset, static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+#endif
+        previous = offset;
+        previousLength = length;
+        offset += static_cast<off_t>(length);
+    }
+
+    // Flush and drop whatever is still cached, including the last chunk
+    if (::fdatasync(out) != 0) {
+        ec = lastError();
+        return false;
+    }
+#if defined(POSIX_FADV_DONTNEED)
+    ::posix_fadvise(out, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    return true;
+}
+#endif
+
+CopyStrategy copyFileData(const fs::path& src, const fs::path& dst, ReflinkMode reflink, std::error_code& ec) {
+    return copyFileData(src, dst, reflink, SparseMode::Auto, ec);
+}
+
+CopyStrategy copyFileData(const fs::path& src, const fs::path& dst, ReflinkMode reflink, SparseMode sparse,
+                          std::error_code& ec, ProgressMeter* progress, SHA256* digest) {
+    CopyOptions options;
+    options.reflink = reflink;
+    options.sparse = sparse;
+    options.progress = progress;
+    return copyFileData(src, dst, options, ec, digest);
+}
+
+// Create (or truncate) dst with src's contents and permission bits. Tries a
+// reflink clone, a hole-preserving copy for sparse sources, copy_file_range,
+// sendfile and finally a read/write loop, moving on only while the previous
+// mechanism reports it cannot handle this pair of files. With --direct the
+// data goes through the O_DIRECT pipeline (or the uncached loop) after the
+// clone attempt instead. Returns the strategy that copied the data, or None
+// with ec set. With a digest the copied bytes are also hashed, so only the
+// paths that read them into user space are used.
+CopyStrategy copyFileData(const fs::path& src, const fs::path& dst, const CopyOptions& options, std::error_code& ec,
+                          SHA256* digest) {
+    const ReflinkMode reflink = options.reflink;
+    const SparseMode sparse = options.sparse;
+    ProgressMeter* progress = options.progress;
+    ec.clear();
+#if !defined(_WIN32)
+    ScopedFd in(::open(src.c_str(), O_RDONLY | O_CLOEXEC));
+    if (in.fd < 0) {
+        ec = lastError();
+        return CopyStrategy::None;
+    }
+    struct stat st;
+    if (::fstat(in.fd, &st) != 0) {
+        ec = lastError();
+        return CopyStrategy::None;
+    }
+    ScopedFd out(::open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600));
+    if (out.fd < 0) {
+        ec = lastError();
+        return CopyStrategy::None;
+    }
+    ::fchmod(out.fd, st.st_mode & 07777);
+
+    const std::uintmax_t size = S_ISREG(st.st_mode) ? static_cast<std::uintmax_t>(st.st_size) : 0;
+    CopyStrategy strategy = CopyStrategy::None;
+    Offload result = Offload::Unsupported;
+
+    // A digest needs the bytes in user space, which only the sparse and
+    // read/write paths see
+    const bool offload = digest == nullptr;
+
+    if (offload && reflink != ReflinkMode::Never) {
+        result = tryReflink(in.fd, out.fd, ec);
+        if (result == Offload::Done) {
+            strategy = CopyStrategy::Reflink;
+            if (progress) progress->addBytes(size);
+        } else if (reflink == ReflinkMode::Always) {
+            return CopyStrategy::None;
+        }
+    }
+    // --direct writes every byte, holes included, and does not fall back to
+    // the strategies below, which all go through the page cache
+    if (options.direct && result == Offload::Unsupported && size > 0) {
+        ec.clear();
+        result = tryDirectCopy(in.fd, out.fd, progress, digest, ec);
+        if (result == Offload::Done) strategy = CopyStrategy::Direct;
+        if (result == Offload::Unsupported) {
+            ec.clear();
+            if (!uncachedLoop(in.fd, out.fd, progress, digest, ec)) return CopyStrategy::None;
+            result = Offload::Done;
+            strategy = CopyStrategy::Uncached;
+        }
+    }
+    // Fewer allocated blocks than the size implies means the file has holes;
+    // copy_file_range and sendfile would fill them in
+    const bool hasHoles = static_cast<std::uintmax_t>(st.st_blocks) * 512 < size;
+    if (result == Offload::Unsupported && size > 0 &&
+        (sparse == SparseMode::Always || (sparse == SparseMode::Auto && hasHoles))) {
+        ec.clear();
+        result = trySparseCopy(in.fd, out.fd, size, sparse == SparseMode::Always, progress, digest, ec);
+        if (result == Offload::Done) strategy = CopyStrategy::Sparse;
+    }
+    // Files reporting size 0 may still have contents (e.g. /proc): read them
+    if (offload && result == Offload::Unsupported && reflink != ReflinkMode::Never && size > 0) {
+        ec.clear();
+        result = tryCopyFileRange(in.fd, out.fd, size, progress, ec);
+        if (result == Offload::Done) strategy = CopyStrategy::CopyFileRange;
+    }
+    if (offload && result == Offload::Unsupported && size > 0) {
+        ec.clear();
+        result = trySendfile(in.fd, out.fd, size, progress, ec);
+        if (result == Offload::Done) strategy = CopyStrategy::Sendfile;
+    }
+    if (result == Offload::Unsupported) {
+        ec.clear();
+        if (!readWriteLoop(in.fd, out.fd, progress, digest, ec)) return CopyStrategy::None;
+        strategy = CopyStrategy::ReadWrite;
+    }
+    if (result == Offload::Failed) return CopyStrategy::None;
+
+    if (::close(out.fd) != 0) {
+        out.fd = -1;
+        ec = lastError();
+        return CopyStrategy::None;
+    }
+    out.fd = -1;
+    return strategy;
+#else
+    (void)sparse;
+    if (reflink == ReflinkMode::Always) {
+        ec = std::make_error_code(std::errc::operation_not_supported);
+        return CopyStrategy::None;
+    }
+    fs::copy_file(src, dst, fs::copy_options::overwrite_existing, ec);
+    if (!ec && progress) progress->addBytes(fs::file_size(dst, ec));
+    if (!ec && digest) {
+        std::ifstream file(src, std::ios::binary);
+        AlignedBuffer buffer(kCopyBufferSize);
+        while (file) {
+            file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+            if (file.gcount() > 0) digest->update(buffer.data(), static_cast<std::size_t>(file.gcount()));
+        }
+        if (file.bad()) ec = std::make_error_code(std::errc::io_error);
+    }
+    return ec ? CopyStrategy::None : CopyStrategy::ReadWrite;
+#endif
+}
+
 // Returns true if a filesystem path exists
 bool pathExists(const fs::path& p) {
     std::error_code ec;
     return fs::exists(p, ec);
 }
 
-// Copies a single file, returns true on success
-bool copySingleFile(const fs::path& src, const fs::path& dst, bool force) {
+// Compare two files byte by byte, stopping at the first difference
+static bool sameContents(const fs::path& a, const fs::path& b) {
+    std::ifstream fa(a, std::ios::binary);
+    std::ifstream fb(b, std::ios::binary);
+    if (!fa || !fb) return false;
+
+    AlignedBuffer bufA(kCopyBufferSize);
+    AlignedBuffer bufB(kCopyBufferSize);
+    while (true) {
+        fa.read(reinterpret_cast<char*>(bufA.data()), static_cast<std::streamsize>(bufA.size()));
+        fb.read(reinterpret_cast<char*>(bufB.data()), static_cast<std::streamsize>(bufB.size()));
+        const std::streamsize na = fa.gcount();
+        if (na != fb.gcount() || std::memcmp(bufA.data(), bufB.data(), static_cast<std::size_t>(na)) != 0) {
+            return false;
+        }
+        if (na == 0 || !fa || !fb) return fa.eof() && fb.eof() && (!fa.bad() && !fb.bad());
+    }
+}
+
+// --update / --checksum: true if dst is a regular file that already matches
+// src (same size, and same mtime or same contents)
+bool destinationUpToDate(const fs::path& src, const fs::path& dst, bool compareContents) {
+    std::error_code ec;
+    if (!fs::is_regular_file(dst, ec)) return false;
+    const std::uintmax_t srcSize = fs::file_size(src, ec);
+    if (ec) return false;
+    const std::uintmax_t dstSize = fs::file_size(dst, ec);
+    if (ec || srcSize != dstSize) return false;
+
+    if (compareContents) return sameContents(src, dst);
+
+    const auto srcTime = fs::last_write_time(src, ec);
+    if (ec) return false;
+    const auto dstTime = fs::last_write_time(dst, ec);
+    return !ec && srcTime == dstTime;
+}
+
+// rsync's heuristic: about sqrt(size) rounded down to a multiple of 8, so
+// there are few blocks to track and a small change rewrites little
+std::size_t deltaBlockSize(std::uintmax_t fileSize) {
+    auto root = static_cast<std::uintmax_t>(std::sqrt(static_cast<double>(fileSize)));
+    root &= ~std::uintmax_t{7};
+    return static_cast<std::size_t>(
+        std::clamp<std::uintmax_t>(root, kDeltaMinBlockSize, kDeltaMaxBlockSize));
+}
+
+namespace {
+
+// Read up to length bytes; returns the count read (short only at EOF)
+std::size_t readChunk(std::istream& in, std::uint8_t* data, std::size_t length) {
+    in.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(length));
+    return static_cast<std::size_t>(in.gcount());
+}
+
+// Outcome of copying one file
+struct FileCopyResult {
+    CopyStrategy strategy = CopyStrategy::None;
+    bool skipped = false;              // destination already up to date
+    std::uintmax_t bytes = 0;          // bytes written (file size, or changed blocks for --delta)
+    DeltaResult delta;
+    std::string digest;                // --verify: SHA-256 of the destination contents
+};
+
+} // namespace
+
+// Update dst in place so it matches src, writing only the blocks that
+// differ. Both files are read front to back a chunk at a time and each
+// source block is compared with the destination block at the same offset,
+// so only same-offset blocks can match: an insertion rewrites everything
+// after it. Fails with permission_denied, before anything is read, when dst
+// cannot be opened for writing, so the caller can replace it instead.
+bool deltaCopyFile(const fs::path& src, const fs::path& dst, DeltaResult& result, std::error_code& ec,
+                   SHA256* sourceDigest) {
+    ec.clear();
+    result = DeltaResult{};
+    const std::uintmax_t srcSize = fs::file_size(src, ec);
+    if (ec) return false;
+    const std::uintmax_t dstSize = fs::file_size(dst, ec);
+    if (ec) return false;
+
+    std::fstream out(dst, std::ios::binary | std::ios::in | std::ios::out);
+    if (!out) {
+        ec = std::make_error_code(std::errc::permission_denied);
+        return false;
+    }
+    std::ifstream in(src, std::ios::binary);
+    if (!in) {
+        ec = std::make_error_code(std::errc::io_error);
+        return false;
+    }
+
+    const std::size_t blockSize = deltaBlockSize(std::max(srcSize, dstSize));
+    const std::size_t chunkSize = blockSize * std::max<std::size_t>(1, kCopyBufferSize / blockSize);
+    AlignedBuffer buffer(chunkSize);
+    AlignedBuffer current(chunkSize);     // destination bytes at the same offset
+    result.blockSize = blockSize;
+
+    std::uintmax_t offset = 0;
+    std::size_t n;
+    while ((n = readChunk(in, buffer.data(), chunkSize)) > 0) {
+        if (sourceDigest) sourceDigest->update(buffer.data(), n);
+
+        std::size_t have = 0;
+        if (offset < dstSize) {
+            out.seekg(static_cast<std::streamoff>(offset));
+            have = readChunk(out, current.data(),
+                             static_cast<std::size_t>(std::min<std::uintmax_t>(n, dstSize - offset)));
+            if (out.bad()) break;
+            out.clear();
+        }
+
+        std::size_t runStart = 0;
+        std::size_t runLength = 0;
+        auto flushRun = [&]() {
+            if (runLength == 0) return true;
+            out.seekp(static_cast<std::streamoff>(offset + runStart));
+            out.write(reinterpret_cast<const char*>(buffer.data() + runStart),
+                      static_cast<std::streamsize>(runLength));
+            result.bytesWritten += runLength;
+            runLength = 0;
+            return static_cast<bool>(out);
+        };
+
+        for (std::size_t off = 0; off < n; off += blockSize) {
+            const std::size_t len = std::min(blockSize, n - off);
+            ++result.blocks;
+            // A shorter final source block matching the start of a longer
+            // destination block is fine: the file is truncated below
+            if (off + len <= have && std::memcmp(buffer.data() + off, current.data() + off, len) == 0) {
+                if (!flushRun()) break;
+                continue;
+            }
+            if (runLength == 0) runStart = off;
+            runLength += len;
+            ++result.blocksRewritten;
+        }
+        if (!flushRun()) break;
+        offset += n;
+    }
+    if (in.bad() || !out) {
+        ec = std::make_error_code(std::errc::io_error);
+        return false;
+    }
+    out.close();
+    if (out.fail()) {
+        ec = std::make_error_code(std::errc::io_error);
+        return false;
+    }
+
+    if (dstSize > srcSize) {
+        fs::resize_file(dst, srcSize, ec);
+        if (ec) return false;
+    }
+    const fs::file_status srcStatus = fs::status(src, ec);
+    if (ec) return false;
+    fs::permissions(dst, srcStatus.permissions(), ec);
+    return !ec;
+}
+
+// Hash a file as stored. With direct the file is read with O_DIRECT where
+// the filesystem allows it, otherwise its cached pages are written back and
+// dropped first, so the digest comes from the device rather than from the
+// page cache the copy just filled.
+bool hashStoredFile(const fs::path& path, bool direct, std::string& hex, std::error_code& ec) {
+    ec.clear();
+    SHA256 sha;
+#if !defined(_WIN32)
+    int flags = O_RDONLY | O_CLOEXEC;
+#if defined(O_DIRECT)
+    if (direct) flags |= O_DIRECT;
+#endif
+    ScopedFd in(::open(path.c_str(), flags));
+    if (in.fd < 0 && direct && errno == EINVAL) {
+        in.fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#if defined(POSIX_FADV_DONTNEED)
+        if (in.fd >= 0) {
+            ::fdatasync(in.fd);
+            ::posix_fadvise(in.fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+#endif
+    }
+    if (in.fd < 0) {
+        ec = lastError();
+        return false;
+    }
+
+    // O_DIRECT needs an aligned buffer; the tail comes back as a short read
+    AlignedBuffer buffer(kCopyBufferSize);
+    while (true) {
+        ssize_t n = ::read(in.fd, buffer.data(), buffer.size());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ec = lastError();
+            return false;
+        }
+        if (n == 0) break;
+        sha.update(buffer.data(), static_cast<std::size_t>(n));
+    }
+#else
+    (void)direct;
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        ec = std::make_error_code(std::errc::io_error);
+        return false;
+    }
+    AlignedBuffer buffer(kCopyBufferSize);
+    std::size_t n;
+    while ((n = readChunk(in, buffer.data(), buffer.size())) > 0) sha.update(buffer.data(), n);
+    if (in.bad()) {
+        ec = std::make_error_code(std::errc::io_error);
+        return false;
+    }
+#endif
+    sha.finalize();
+    hex = sha.hexDigest();
+    return true;
+}
+
+// Quote a path the way sha256sum does: names containing a backslash or a
+// newline are escaped and the line is prefixed with a backslash
+static std::string manifestLine(const std::string& digest, const std::string& path) {
+    if (path.find_first_of("\\\n") == std::string::npos) return digest + "  " + path + "\n";
+    std::string escaped;
+    for (char c : path) {
+        if (c == '\\') escaped += "\\\\";
+        else if (c == '\n') escaped += "\\n";
+        else escaped += c;
+    }
+    return "\\" + digest + "  " + escaped + "\n";
+}
+
+// Write a sha256sum-format manifest, sorted by path so parallel copies
+// produce the same file
+bool writeCopyManifest(const fs::path& manifestPath, std::vector<CopyDigest> digests, std::error_code& ec) {
+    ec.clear();
+    std::sort(digests.begin(), digests.end(),
+              [](const CopyDigest& a, const CopyDigest& b) { return a.path < b.path; });
+    std::ofstream out(manifestPath, std::ios::binary | std::ios::trunc);
+    for (const auto& d : digests) out << manifestLine(d.sha256, d.path.string());
+    out.close();
+    if (!out) ec = std::make_error_code(std::errc::io_error);
+    return !ec;
+}
+
+static bool syncMode(const CopyOptions& options) {
+    return options.update || options.checksum;
+}
+
+// --verify: compare the digest of the bytes that were copied with a fresh
+// read of the destination
+static bool verifyCopy(const fs::path& src, const fs::path& dst, const CopyOptions& options, SHA256& copied,
+                       FileCopyResult& result, std::string& error) {
+    copied.finalize();
+    result.digest = copied.hexDigest();
+
+    std::string stored;
+    std::error_code ec;
+    if (!hashStoredFile(dst, options.verifyDirect, stored, ec)) {
+        error = "Error verifying \"" + dst.string() + "\": " + ec.message();
+        return false;
+    }
+    if (stored != result.digest) {
+        error = "Error: verification failed, \"" + dst.string() + "\" does not match \"" + src.string() +
+                "\" (sha256 " + stored + ", expected " + result.digest + ")";
+        return false;
+    }
+    return true;
+}
+
+static bool transferFile(const fs::path& src, const fs::path& dst, const CopyOptions& options,
+                         FileCopyResult& result, std::string& error) {
     std::error_code ec;
+    SHA256 sha;
+    SHA256* digest = options.verify ? &sha : nullptr;
+
+    if (syncMode(options) && destinationUpToDate(src, dst, options.checksum)) {
+        result.skipped = true;
+        if (options.progress) options.progress->addBytes(fs::file_size(src, ec));
+        // Unchanged files still get a manifest line
+        if (options.verify && !hashStoredFile(dst, options.verifyDirect, result.digest, ec)) {
+            error = "Error verifying \"" + dst.string() + "\": " + ec.message();
+            return false;
+        }
+        return true;
+    }
 
     if (pathExists(dst)) {
-        if (!force) {
-            std::cerr
-                << "Error: \"" << dst.string()
-                << "\" already exists (use --force to overwrite)\n";
+        // Replacing the destination would delete the source (same path,
+        // hard link or symlink to it), so refuse like cp does
+        std::error_code sameEc;
+        if (fs::equivalent(src, dst, sameEc)) {
+            error = "Error: \"" + src.string() + "\" and \"" + dst.string() + "\" are the same file";
             return false;
         }
+
+        // Sync and delta modes replace files that differ
+        if (!options.force && !syncMode(options) && !options.delta) {
+            error = "Error: \"" + dst.string() + "\" already exists (use --force to overwrite)";
+            return false;
+        }
+
+        // A failed delta leaves the partly updated file in place: the next
+        // --delta run then only rewrites what is still different. A
+        // destination that cannot be written in place (e.g. read-only) is
+        // replaced below instead, as a plain --force copy would.
+        if (options.delta && fs::is_regular_file(dst, ec) &&
+            (deltaCopyFile(src, dst, result.delta, ec, digest) || ec != std::errc::permission_denied)) {
+            if (ec) {
+                error = "Error updating \"" + dst.string() + "\" from \"" + src.string() + "\": " + ec.message();
+                return false;
+            }
+            result.strategy = CopyStrategy::Delta;
+            result.bytes = result.delta.bytesWritten;
+            if (options.progress) options.progress->addBytes(fs::file_size(src, ec));
+            if (syncMode(options)) {
+                const auto srcTime = fs::last_write_time(src, ec);
+                if (!ec) fs::last_write_time(dst, srcTime, ec);
+            }
+            return !digest || verifyCopy(src, dst, options, sha, result, error);
+        }
+
         fs::remove(dst, ec);
         if (ec) {
-            std::cerr << "Error: Could not overwrite \"" << dst.string()
-                      << "\": " << ec.message() << "\n";
+            error = "Error: Could not overwrite \"" + dst.string() + "\": " + ec.message();
             return false;
         }
     }
 
-    fs::copy_file(src, dst, fs::copy_options::overwrite_existing, ec);
-    if (ec) {
-        std::cerr << "Error copying \"" << src.string()
-                  << "\" → \"" << dst.string()
-                  << "\": " << ec.message() << "\n";
+    result.strategy = copyFileData(src, dst, options, ec, digest);
+    if (result.strategy == CopyStrategy::None) {
+        error = "Error copying \"" + src.string() + "\" → \"" + dst.string() + "\": " + ec.message();
+        std::error_code rmEc;
+        fs::remove(dst, rmEc);
+        return false;
+    }
+    if (digest && !verifyCopy(src, dst, options, sha, result, error)) {
+        std::error_code rmEc;
+        fs::remove(dst, rmEc);
+        return false;
+    }
+    result.bytes = fs::file_size(dst, ec);
+    if (ec) result.bytes = 0;
+
+    // Keep the source mtime so the next --update run sees the file as unchanged
+    if (syncMode(options)) {
+        const auto srcTime = fs::last_write_time(src, ec);
+        if (!ec) fs::last_write_time(dst, srcTime, ec);
+    }
+    return true;
+}
+
+// Copy one regular file without printing. On failure error holds the
+// message that would be shown to the user.
+static bool copyFileQuiet(const fs::path& src, const fs::path& dst, const CopyOptions& options,
+                          FileCopyResult& result, std::string& error) {
+    if (!options.progress) return transferFile(src, dst, options, result, error);
+
+    options.progress->setCurrent(src);
+    const bool ok = transferFile(src, dst, options, result, error);
+    if (ok) options.progress->addFiles();
+    return ok;
+}
+
+// One "Copied" line, written with a single stream insertion so lines
+// from concurrent workers do not interleave
+static void reportCopied(const fs::path& src, const fs::path& dst, const CopyOptions& options,
+                         const FileCopyResult& result) {
+    if (result.skipped) {
+        if (options.verbose) std::cout << "Unchanged \"" + dst.string() + "\"\n";
+        return;
+    }
+    std::string line = "Copied \"" + src.string() + "\" → \"" + dst.string() + "\"";
+    if (options.verbose) {
+        line += std::string(" (") + copyStrategyName(result.strategy);
+        if (result.strategy == CopyStrategy::Delta) {
+            line += ", " + std::to_string(result.delta.blocksRewritten) + " of " +
+                    std::to_string(result.delta.blocks) + " blocks rewritten";
+        }
+        if (options.verify) line += ", verified";
+        line += ")";
+    } else if (options.verify) {
+        line += " (verified)";
+    }
+    line += "\n";
+    std::cout << line;
+}
+
+// Bytes actually written and entries left alone or removed, printed after
+// --update / --checksum / --delete copies
+static void printTransferSummary(const CopyReport& report) {
+    std::cout << "Transferred " << report.bytesCopied << " bytes in " << report.filesCopied << " file(s), "
+              << report.filesUnchanged << " unchanged, " << report.entriesDeleted << " deleted\n";
+}
+
+// Copies a single file, returns true on success
+bool copySingleFile(const fs::path& src, const fs::path& dst, bool force) {
+    CopyOptions options;
+    options.force = force;
+    return copySingleFile(src, dst, options);
+}
+
+bool copySingleFile(const fs::path& src, const fs::path& dst, const CopyOptions& options) {
+    CopyReport report;
+    return copySingleFile(src, dst, options, report);
+}
+
+bool copySingleFile(const fs::path& src, const fs::path& dst, const CopyOptions& options, CopyReport& report) {
+    FileCopyResult result;
+    std::string error;
+    if (!copyFileQuiet(src, dst, options, result, error)) {
+        if (options.progress) options.progress->addError();
+        ++report.errors;
+        std::cerr << error << "\n";
         return false;
     }
+    if (result.skipped) {
+        ++report.filesUnchanged;
+    } else {
+        ++report.filesCopied;
+        report.bytesCopied += result.bytes;
+    }
+    if (!result.digest.empty()) report.digests.push_back({dst, result.digest});
+    if (result.skipped && !options.verbose) {
+        std::cout << "Skipped \"" << src.string() << "\" (destination is up to date)\n";
+    }
+    reportCopied(src, dst, options, result);
+    if (syncMode(options)) printTransferSummary(report);
+    return true;
+}
 
-    std::cout << "Copied \"" << src.string()
-              << "\" → \"" << dst.string() << "\"\n";
+// Identity of a file with more than one hard link
+static bool multiplyLinked(const fs::path& path, FileId& id) {
+#if !defined(_WIN32)
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0 || st.st_nlink < 2) return false;
+    id = {static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino)};
     return true;
+#else
+    (void)path;
+    (void)id;
+    return false;
+#endif
 }
 
+namespace {
+
+// A directory to create and list, or a file to copy
+struct CopyTask {
+    fs::path from;
+    fs::path to;
+    bool isDirectory = false;
+};
+
+struct TreeCopy {
+    const CopyOptions& options;
+    WorkStealingPool<CopyTask> pool;
+    std::atomic<std::size_t> files{0};
+    std::atomic<std::size_t> skipped{0};
+    std::atomic<std::size_t> deleted{0};
+    std::atomic<std::uintmax_t> bytes{0};
+    std::atomic<std::size_t> directories{0};
+    std::atomic<std::size_t> listingsPending{1};   // the root; --progress totals are final at 0
+    std::mutex errorMutex;
+    std::vector<std::string> errors;
+    std::mutex digestMutex;
+    std::vector<CopyDigest> digests;
+
+    // --preserve-links: the first path reached for a multiply-linked source
+    // inode copies the data and becomes its owner; the other paths are
+    // linked to the owner's copy after the walk, once every owner is done
+    struct LinkOwner {
+        fs::path destination;
+        bool copied = false;
+        std::string digest;
+    };
+    struct PendingLink {
+        CopyTask task;
+        std::uint32_t owner = 0;
+    };
+    static constexpr std::uint32_t kNoOwner = ~std::uint32_t{0};
+    FileIdMap<std::uint32_t> linkOwners;
+    std::atomic<std::uint32_t> nextOwner{0};
+    std::atomic<std::size_t> linked{0};
+    std::mutex linkMutex;
+    std::vector<LinkOwner> owners;
+    std::vector<PendingLink> pendingLinks;
+
+    TreeCopy(const CopyOptions& opts, unsigned jobs) : options(opts), pool(jobs) {}
+
+    void fail(std::string message) {
+        if (options.progress) options.progress->addError();
+        std::lock_guard<std::mutex> lock(errorMutex);
+        errors.push_back(std::move(message));
+    }
+
+    // A directory task runs only after its parent was created, so
+    // directories are created in dependency order without a separate pass
+    void copyDirectoryTask(const CopyTask& task, unsigned worker) {
+        std::error_code ec;
+        fs::create_directory(task.to, ec);
+        if (ec) {
+            fail("Error creating directory \"" + task.to.string() + "\": " + ec.message());
+            return;   // nothing below it can be copied
+        }
+        directories.fetch_add(1, std::memory_order_relaxed);
+
+        fs::directory_iterator it(task.from, ec);
+        if (ec) {
+            fail("Error reading directory \"" + task.from.string() + "\": " + ec.message());
+            return;
+        }
+        std::unordered_set<fs::path::string_type> names;
+        for (; it != fs::directory_iterator(); it.increment(ec)) {
+            const fs::directory_entry& entry = *it;
+            if (options.deleteExtraneous) names.insert(entry.path().filename().native());
+            std::error_code typeEc;
+            CopyTask child{entry.path(), task.to / entry.path().filename(), false};
+            if (entry.is_directory(typeEc)) {
+                child.isDirectory = true;
+                listingsPending.fetch_add(1, std::memory_order_relaxed);
+                pool.push(worker, std::move(child));
+            } else if (entry.is_regular_file(typeEc)) {
+                if (options.progress) options.progress->expect(1, entry.file_size(typeEc));
+                pool.push(worker, std::move(child));
+            } else {
+                std::cerr << "Skipping non-regular file: " + entry.path().string() + "\n";
+            }
+        }
+        if (ec) {
+            // Never delete based on an incomplete listing
+            fail("Error reading directory \"" + task.from.string() + "\": " + ec.message());
+            return;
+        }
+        if (options.deleteExtraneous) deleteExtraneous(task.to, names);
+    }
+
+    // --delete: remove destination entries that have no source counterpart
+    void deleteExtraneous(const fs::path& directory, const std::unordered_set<fs::path::string_type>& keep) {
+        std::error_code ec;
+        std::vector<fs::path> extraneous;
+        for (fs::directory_iterator it(directory, ec); !ec && it != fs::directory_iterator(); it.increment(ec)) {
+            if (!keep.count(it->path().filename().native())) extraneous.push_back(it->path());
+        }
+        for (const auto& path : extraneous) {
+            std::error_code rmEc;
+            fs::remove_all(path, rmEc);
+            if (rmEc) {
+                fail("Error deleting \"" + path.string() + "\": " + rmEc.message());
+                continue;
+            }
+            deleted.fetch_add(1, std::memory_order_relaxed);
+            std::cout << "Deleted \"" + path.string() + "\"\n";
+        }
+    }
+
+    void copyFileTask(const CopyTask& task) {
+        std::uint32_t ownerIndex = kNoOwner;
+        FileId id;
+        if (options.preserveLinks && multiplyLinked(task.from, id)) {
+            ownerIndex = nextOwner.fetch_add(1, std::memory_order_relaxed);
+            std::uint32_t owner = 0;
+            if (!linkOwners.insert(id, ownerIndex, &owner)) {
+                std::lock_guard<std::mutex> lock(linkMutex);
+                pendingLinks.push_back({task, owner});
+                return;
+            }
+        }
+        copyFile(task, ownerIndex);
+    }
+
+    void copyFile(const CopyTask& task, std::uint32_t ownerIndex) {
+        FileCopyResult result;
+        std::string error;
+        const bool ok = copyFileQuiet(task.from, task.to, options, result, error);
+        if (ownerIndex != kNoOwner) {
+            std::lock_guard<std::mutex> lock(linkMutex);
+            if (owners.size() <= ownerIndex) owners.resize(ownerIndex + 1);
+            owners[ownerIndex] = {task.to, ok, result.digest};
+        }
+        if (!ok) {
+            fail(std::move(error));
+            return;
+        }
+        if (result.skipped) {
+            skipped.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            files.fetch_add(1, std::memory_order_relaxed);
+            bytes.fetch_add(result.bytes, std::memory_order_relaxed);
+        }
+        recordDigest(task.to, result.digest);
+        reportCopied(task.from, task.to, options, result);
+    }
+
+    // Runs on one thread after the pool: link each pending path to its
+    // owner's copy, or copy it on its own if the owner failed or the
+    // filesystem refuses the link
+    void createPendingLinks() {
+        for (const auto& link : pendingLinks) {
+            const LinkOwner& owner = owners[link.owner];
+            const fs::path& to = link.task.to;
+            if (!owner.copied) {
+                copyFile(link.task, kNoOwner);
+                continue;
+            }
+
+            std::error_code ec;
+            if (fs::equivalent(owner.destination, to, ec)) {
+                skipped.fetch_add(1, std::memory_order_relaxed);
+                if (options.progress) options.progress->addFiles();
+                recordDigest(to, owner.digest);
+                if (options.verbose) std::cout << "Unchanged \"" + to.string() + "\"\n";
+                continue;
+            }
+            if (pathExists(to)) {
+                if (!options.force && !syncMode(options) && !options.delta) {
+                    fail("Error: \"" + to.string() + "\" already exists (use --force to overwrite)");
+                    continue;
+                }
+                fs::remove(to, ec);
+                if (ec) {
+                    fail("Error: Could not overwrite \"" + to.string() + "\": " + ec.message());
+                    continue;
+                }
+            }
+
+            fs::create_hard_link(owner.destination, to, ec);
+            if (ec) {
+                copyFile(link.task, kNoOwner);
+                continue;
+            }
+            linked.fetch_add(1, std::memory_order_relaxed);
+            if (options.progress) options.progress->addFiles();
+            recordDigest(to, owner.digest);
+            std::cout << "Linked \"" + to.string() + "\" → \"" + owner.destination.string() + "\"\n";
+        }
+    }
+
+    void recordDigest(const fs::path& path, const std::string& digest) {
+        if (digest.empty()) return;
+        std::lock_guard<std::mutex> lock(digestMutex);
+        digests.push_back({path, digest});
+    }
+};
+
+} // namespace
+
 // Handles recursive directory copy, returns true on success
 bool copyDirectory(const fs::path& src, const fs::path& dst, bool force, bool recursive) {
+    CopyOptions options;
+    options.force = force;
+    options.recursive = recursive;
+    return copyDirectory(src, dst, options);
+}
+
+// Directories and files are tasks on a work-stealing pool (options.jobs
+// workers, 1 = copy on the calling thread). A failure is recorded and the
+// rest of the tree is still copied; all failures are listed at the end.
+bool copyDirectory(const fs::path& src, const fs::path& dst, const CopyOptions& options) {
+    CopyReport report;
+    return copyDirectory(src, dst, options, report);
+}
+
+bool copyDirectory(const fs::path& src, const fs::path& dst, const CopyOptions& options, CopyReport& report) {
     // Check recursion requirement
-    if (!recursive) {
+    if (!options.recursive) {
         std::cerr
             << "Error: Source is a directory but --recursive not specified.\n";
         return false;
@@ -66,27 +1327,39 @@ bool copyDirectory(const fs::path& src, const fs::path& dst, bool force, bool re
         }
     }
 
-    // Iterate through directory contents
-    for (const auto& entry : fs::directory_iterator(src)) {
-        fs::path from = entry.path();
-        fs::path to = dst / from.filename();
+    unsigned jobs = options.jobs;
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
 
-        if (entry.is_directory()) {
-            // Recursive copy into subdirectory
-            if (!copyDirectory(from, to, force, recursive)) {
-                return false;
-            }
-        }
-        else if (entry.is_regular_file()) {
-            if (!copySingleFile(from, to, force)) {
-                return false;
-            }
+    TreeCopy copy(options, jobs);
+    copy.pool.push(0, CopyTask{src, dst, true});
+    copy.pool.run([&copy, &options](CopyTask& task, unsigned worker) {
+        if (!task.isDirectory) {
+            copy.copyFileTask(task);
+            return;
         }
-        else {
-            std::cerr << "Skipping non-regular file: " << from.string() << "\n";
+        copy.copyDirectoryTask(task, worker);
+        // Every directory has been listed: nothing more will be discovered
+        if (copy.listingsPending.fetch_sub(1, std::memory_order_acq_rel) == 1 && options.progress) {
+            options.progress->totalsKnown();
         }
-    }
+    });
+    copy.createPendingLinks();
+
+    report.filesCopied = copy.files.load();
+    report.filesUnchanged = copy.skipped.load();
+    report.entriesDeleted = copy.deleted.load();
+    report.linksCreated = copy.linked.load();
+    report.bytesCopied = copy.bytes.load();
+    report.errors = copy.errors.size();
+    report.digests = std::move(copy.digests);
 
+    if (syncMode(options) || options.deleteExtraneous) printTransferSummary(report);
+
+    if (!copy.errors.empty()) {
+        std::cerr << "Failed to copy " << copy.errors.size() << " item(s):\n";
+        for (const auto& error : copy.errors) std::cerr << "  " << error << "\n";
+        return false;
+    }
     return true;
 }
 
@@ -97,6 +1370,32 @@ void CopyCommand::run() const {
 
     std::error_code ec;
 
+    CopyOptions options;
+    options.force = force;
+    options.recursive = recursive;
+    options.verbose = verbose;
+    options.jobs = jobs;
+    options.update = update;
+    options.checksum = checksum;
+    options.deleteExtraneous = deleteExtraneous;
+    options.delta = delta;
+    options.preserveLinks = preserveLinks;
+    options.direct = direct;
+    options.verify = verify || verifyDirect || !manifest.empty();
+    options.verifyDirect = verifyDirect;
+    if (!parseReflinkMode(reflink, options.reflink)) {
+        std::cerr << "Error: Unknown --reflink mode \"" << reflink << "\" (use auto, always or never)\n";
+        return;
+    }
+    if (!parseSparseMode(sparse, options.sparse)) {
+        std::cerr << "Error: Unknown --sparse mode \"" << sparse << "\" (use auto, always or never)\n";
+        return;
+    }
+    if (options.verify && options.reflink == ReflinkMode::Always) {
+        std::cerr << "Error: --verify copies through user space and cannot be combined with --reflink always\n";
+        return;
+    }
+
     // Validate source exists
     if (!fs::exists(src, ec)) {
         std::cerr << "Error: Source path \"" << sourcePath
@@ -104,6 +1403,25 @@ void CopyCommand::run() const {
         return;
     }
 
+    // Stopped (final totals printed) when run() returns
+    std::unique_ptr<ProgressMeter> meter;
+    if (progress) {
+        meter = std::make_unique<ProgressMeter>("copy");
+        options.progress = meter.get();
+        meter->start();
+    }
+
+    // --manifest: digests of every verified destination file, including
+    // those of a partly failed copy
+    CopyReport report;
+    auto writeManifest = [&]() {
+        if (manifest.empty()) return;
+        std::error_code manifestEc;
+        if (!writeCopyManifest(manifest, report.digests, manifestEc)) {
+            std::cerr << "Error writing manifest \"" << manifest << "\": " << manifestEc.message() << "\n";
+        }
+    };
+
     // If source is a file
     if (fs::is_regular_file(src, ec)) {
         // If destination is an existing directory, copy inside it (like cp behavior)
@@ -111,7 +1429,12 @@ void CopyCommand::run() const {
             dst /= src.filename();
         }
 
-        copySingleFile(src, dst, force);
+        if (meter) {
+            meter->expect(1, fs::file_size(src, ec));
+            meter->totalsKnown();
+        }
+        copySingleFile(src, dst, options, report);
+        writeManifest();
         return;
     }
 
@@ -123,9 +1446,10 @@ void CopyCommand::run() const {
             return;
         }
 
-        if (!copyDirectory(src, dst, force, recursive)) {
+        if (!copyDirectory(src, dst, options, report)) {
             std::cerr << "Directory copy failed.\n";
         }
+        writeManifest();
         return;
     }
 
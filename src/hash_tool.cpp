@@ -1,33 +1,250 @@
 #include "../include/hash_tool.h"
 #include "../include/sha256.h"
+#include "../include/aligned_buffer.h"
+#include "../include/progress.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace fs = std::filesystem;
 
-// Compute SHA-256 hash of a file using your SHA256 class
-std::string hashFile(const fs::path& filePath, bool& success) {
+#if !defined(_WIN32)
+// Read until the buffer is full or EOF. Returns bytes read, or -1 on error.
+static ssize_t readFully(int fd, uint8_t* buffer, size_t length) {
+    size_t total = 0;
+    while (total < length) {
+        ssize_t n = ::read(fd, buffer + total, length - total);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        total += static_cast<size_t>(n);
+    }
+    return static_cast<ssize_t>(total);
+}
+
+// Hash an open file with a reader thread filling kHashPipelineDepth buffers
+// ahead of the hasher, so disk reads and SHA-256 compression overlap
+static bool hashPipelined(int fd, size_t bufferSize, SHA256& sha, ProgressMeter* progress) {
+    struct Slot {
+        AlignedBuffer buffer;
+        size_t length = 0;
+        bool last = false;
+        bool error = false;
+    };
+
+    std::vector<Slot> slots(kHashPipelineDepth);
+    for (auto& slot : slots) slot.buffer = AlignedBuffer(bufferSize);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t filled = 0;
+
+    std::thread reader([&]() {
+        for (size_t index = 0;; ++index) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() { return filled < slots.size(); });
+            }
+
+            Slot& slot = slots[index % slots.size()];
+            ssize_t n = readFully(fd, slot.buffer.data(), slot.buffer.size());
+            slot.error = (n < 0);
+            slot.length = slot.error ? 0 : static_cast<size_t>(n);
+            slot.last = slot.error || slot.length < slot.buffer.size();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++filled;
+            }
+            cv.notify_all();
+
+            if (slot.last) return;
+        }
+    });
+
+    bool ok = true;
+    for (size_t index = 0;; ++index) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return filled > 0; });
+        }
+
+        Slot& slot = slots[index % slots.size()];
+        if (slot.error) ok = false;
+        else if (slot.length > 0) sha.update(slot.buffer.data(), slot.length);
+        if (progress) progress->addBytes(slot.length);
+        const bool last = slot.last;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --filled;
+        }
+        cv.notify_all();
+
+        if (last) break;
+    }
+
+    reader.join();
+    return ok;
+}
+#endif
+
+// Compute SHA-256 hash of a file using your SHA256 class. Files larger than
+// one buffer are read ahead on a separate thread while the previous buffer
+// is hashed.
+std::string hashFile(const fs::path& filePath, bool& success, std::size_t bufferSize, ProgressMeter* progress) {
     success = false;
+    if (bufferSize < kMinHashBufferSize) bufferSize = kMinHashBufferSize;
+
+    SHA256 sha;
+
+#if !defined(_WIN32)
+    int fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return "<ERROR: unable to open file>";
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return "<ERROR: unable to read file>";
+    }
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    bool ok = true;
+    const uintmax_t fileSize = S_ISREG(st.st_mode) ? static_cast<uintmax_t>(st.st_size) : 0;
+
+    if (S_ISREG(st.st_mode) && fileSize <= bufferSize) {
+        // Small file: one read, no pipeline thread
+        AlignedBuffer buffer(static_cast<size_t>(fileSize) + 1);
+        ssize_t n = readFully(fd, buffer.data(), buffer.size());
+        if (n < 0) {
+            ok = false;
+        } else {
+            sha.update(buffer.data(), static_cast<size_t>(n));
+            if (progress) progress->addBytes(static_cast<std::uint64_t>(n));
+            // File grew since fstat: hash the remainder through the pipeline
+            if (static_cast<size_t>(n) == buffer.size()) ok = hashPipelined(fd, bufferSize, sha, progress);
+        }
+    } else {
+        ok = hashPipelined(fd, bufferSize, sha, progress);
+    }
 
+    ::close(fd);
+    if (!ok) {
+        return "<ERROR: unable to read file>";
+    }
+#else
     std::ifstream file(filePath, std::ios::binary);
     if (!file.is_open()) {
         return "<ERROR: unable to open file>";
     }
 
-    SHA256 sha;
-    std::vector<uint8_t> buffer(4096);
+    AlignedBuffer buffer(bufferSize);
 
-    while (!file.eof()) {
-        file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+    while (file) {
+        file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
         std::streamsize bytesRead = file.gcount();
         if (bytesRead > 0) {
             sha.update(buffer.data(), static_cast<size_t>(bytesRead));
+            if (progress) progress->addBytes(static_cast<std::uint64_t>(bytesRead));
+        }
+    }
+
+    if (file.bad()) {
+        return "<ERROR: unable to read file>";
+    }
+#endif
+
+    sha.finalize();
+    success = true;
+    return sha.hexDigest();
+}
+
+// Offsets of the blocks sampled by quickFingerprint: the first block, the
+// last block and evenly spaced blocks in between. Files small enough to be
+// covered by the samples are read in full (a single offset of 0).
+std::vector<std::uintmax_t> quickSampleOffsets(std::uintmax_t fileSize) {
+    const std::uintmax_t blockSize = kQuickBlockSize;
+    if (fileSize <= blockSize * kQuickSampleBlocks) {
+        return {0};
+    }
+
+    std::vector<std::uintmax_t> offsets;
+    offsets.reserve(kQuickSampleBlocks);
+    const std::uintmax_t span = fileSize - blockSize;
+    for (size_t i = 0; i < kQuickSampleBlocks; ++i) {
+        offsets.push_back(span / (kQuickSampleBlocks - 1) * i);
+    }
+    offsets.back() = span;
+    return offsets;
+}
+
+static void updateWithUint64(SHA256& sha, std::uint64_t value) {
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; ++i) bytes[i] = static_cast<uint8_t>(value >> (8 * i));
+    sha.update(bytes, sizeof(bytes));
+}
+
+// Compute a sampled fingerprint: SHA-256 of a version tag, the file size and
+// each sampled (offset, block) pair. Reads at most
+// kQuickSampleBlocks * kQuickBlockSize bytes regardless of file size.
+std::string quickFingerprint(const fs::path& filePath, bool& success) {
+    success = false;
+
+    std::error_code ec;
+    const std::uintmax_t fileSize = fs::file_size(filePath, ec);
+    if (ec) {
+        return "<ERROR: unable to read file size>";
+    }
+
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file.is_open()) {
+        return "<ERROR: unable to open file>";
+    }
+
+    static const char kTag[] = "toolkit-quick-v1";
+    SHA256 sha;
+    sha.update(reinterpret_cast<const uint8_t*>(kTag), sizeof(kTag) - 1);
+    updateWithUint64(sha, fileSize);
+
+    const std::vector<std::uintmax_t> offsets = quickSampleOffsets(fileSize);
+    const std::uintmax_t blockSize = offsets.size() == 1 ? fileSize : kQuickBlockSize;
+    std::vector<uint8_t> block(static_cast<size_t>(blockSize));
+
+    for (std::uintmax_t offset : offsets) {
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(block.size()));
+        if (static_cast<size_t>(file.gcount()) != block.size()) {
+            return "<ERROR: unable to read file>";
         }
+        updateWithUint64(sha, offset);
+        sha.update(block.data(), block.size());
     }
 
     sha.finalize();
@@ -41,7 +258,8 @@ static void printIndent(int indent) {
 }
 
 // Print hashes of files grouped by extension and recurse into subdirs
-void printDirectoryHashes(const fs::path& dirPath, bool recursive, int indentLevel) {
+void printDirectoryHashes(const fs::path& dirPath, bool recursive, int indentLevel, std::size_t bufferSize, bool quick,
+                          ProgressMeter* progress) {
     std::map<std::string, std::vector<fs::path>> filesByExt;
     std::vector<fs::path> subdirs;
 
@@ -63,13 +281,18 @@ void printDirectoryHashes(const fs::path& dirPath, bool recursive, int indentLev
 
         for (const auto& file : fileList) {
             bool ok;
-            std::string hash = hashFile(file, ok);
+            if (progress) progress->setCurrent(file);
+            std::string hash = quick ? quickFingerprint(file, ok) : hashFile(file, ok, bufferSize, progress);
+            if (progress) {
+                if (ok) progress->addFiles();
+                else progress->addError();
+            }
 
             printIndent(indentLevel + 1);
             std::cout << file.filename().string() << " — ";
 
             if (ok)
-                std::cout << hash << "\n";
+                std::cout << (quick ? "quick:" : "") << hash << "\n";
             else
                 std::cout << "<READ ERROR>\n";
         }
@@ -80,9 +303,238 @@ void printDirectoryHashes(const fs::path& dirPath, bool recursive, int indentLev
         for (const auto& subdir : subdirs) {
             printIndent(indentLevel);
             std::cout << subdir.filename().string() << "/\n";
-            printDirectoryHashes(subdir, true, indentLevel + 1);
+            printDirectoryHashes(subdir, true, indentLevel + 1, bufferSize, quick, progress);
+        }
+    }
+}
+
+// Decode the backslash escapes sha256sum applies to unusual file names
+static bool unescapeManifestPath(const std::string& in, std::string& out) {
+    out.clear();
+    for (size_t i = 0; i < in.size(); ++i) {
+        if (in[i] != '\\') {
+            out += in[i];
+            continue;
+        }
+        if (++i == in.size()) return false;
+        if (in[i] == 'n') out += '\n';
+        else if (in[i] == 'r') out += '\r';
+        else if (in[i] == '\\') out += '\\';
+        else return false;
+    }
+    return true;
+}
+
+static bool isHexDigest(const std::string& s) {
+    if (s.size() != 64) return false;
+    return std::all_of(s.begin(), s.end(), [](unsigned char c) { return std::isxdigit(c); });
+}
+
+// Parse one manifest line in GNU ("<hash>  <file>", "<hash> *<file>")
+// or BSD ("SHA256 (<file>) = <hash>") format. Returns false if malformed.
+bool parseManifestLine(const std::string& rawLine, std::size_t lineNumber, ManifestEntry& entry) {
+    std::string line = rawLine;
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+
+    bool escaped = false;
+    if (!line.empty() && line.front() == '\\') {
+        escaped = true;
+        line.erase(0, 1);
+    }
+
+    std::string hash;
+    std::string name;
+
+    const std::string bsdPrefix = "SHA256 (";
+    if (line.compare(0, bsdPrefix.size(), bsdPrefix) == 0) {
+        size_t sep = line.rfind(") = ");
+        if (sep == std::string::npos || sep < bsdPrefix.size()) return false;
+        name = line.substr(bsdPrefix.size(), sep - bsdPrefix.size());
+        hash = line.substr(sep + 4);
+    } else {
+        if (line.size() < 67 || line[64] != ' ' || (line[65] != ' ' && line[65] != '*')) return false;
+        hash = line.substr(0, 64);
+        name = line.substr(66);
+    }
+
+    if (!isHexDigest(hash) || name.empty()) return false;
+
+    if (escaped) {
+        std::string decoded;
+        if (!unescapeManifestPath(name, decoded)) return false;
+        name = decoded;
+    }
+
+    std::transform(hash.begin(), hash.end(), hash.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    entry.expectedHash = hash;
+    entry.path = name;
+    entry.lineNumber = lineNumber;
+    return true;
+}
+
+// Verify manifest entries with a pool of workers. Entries are hashed in
+// (device, inode) order, which approximates on-disk layout and keeps reads
+// sequential; results are returned in manifest order.
+std::vector<CheckResult> verifyManifestEntries(const std::vector<ManifestEntry>& entries, unsigned jobs, bool failFast,
+                                               std::size_t bufferSize, ProgressMeter* progress) {
+    std::vector<CheckResult> results;
+    results.reserve(entries.size());
+    for (const auto& e : entries) {
+        results.push_back({e, CheckStatus::Skipped});
+    }
+
+    // Stat every entry up front: missing files are resolved immediately and
+    // the rest are ordered for throughput
+    struct PendingEntry {
+        std::size_t index;
+        std::uint64_t device;
+        std::uint64_t inode;
+    };
+    std::vector<PendingEntry> pending;
+    pending.reserve(entries.size());
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+#if !defined(_WIN32)
+        struct stat st;
+        if (::stat(entries[i].path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            results[i].status = CheckStatus::Missing;
+            continue;
+        }
+        pending.push_back({i, static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino)});
+        if (progress) progress->expect(1, static_cast<std::uint64_t>(st.st_size));
+#else
+        std::error_code ec;
+        if (!fs::is_regular_file(entries[i].path, ec)) {
+            results[i].status = CheckStatus::Missing;
+            continue;
+        }
+        pending.push_back({i, 0, i});
+        if (progress) progress->expect(1, fs::file_size(entries[i].path, ec));
+#endif
+    }
+
+    if (progress) progress->totalsKnown();
+
+    std::sort(pending.begin(), pending.end(), [](const PendingEntry& a, const PendingEntry& b) {
+        if (a.device != b.device) return a.device < b.device;
+        return a.inode < b.inode;
+    });
+
+    std::atomic<bool> stop{failFast && pending.size() != entries.size()};
+    std::atomic<size_t> next{0};
+
+    auto worker = [&]() {
+        while (!stop.load(std::memory_order_relaxed)) {
+            size_t slot = next.fetch_add(1, std::memory_order_relaxed);
+            if (slot >= pending.size()) break;
+
+            CheckResult& result = results[pending[slot].index];
+            bool ok;
+            if (progress) progress->setCurrent(result.entry.path);
+            std::string hash = hashFile(result.entry.path, ok, bufferSize, progress);
+            if (progress) {
+                if (ok && hash == result.entry.expectedHash) progress->addFiles();
+                else progress->addError();
+            }
+
+            if (!ok) {
+                result.status = CheckStatus::Missing;
+            } else if (hash != result.entry.expectedHash) {
+                result.status = CheckStatus::Failed;
+            } else {
+                result.status = CheckStatus::Ok;
+            }
+
+            if (failFast && result.status != CheckStatus::Ok) {
+                stop.store(true, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+    jobs = static_cast<unsigned>(std::min<size_t>(jobs, std::max<size_t>(pending.size(), 1)));
+
+    if (jobs == 1) {
+        worker();
+    } else {
+        std::vector<std::thread> threads;
+        threads.reserve(jobs);
+        for (unsigned t = 0; t < jobs; ++t) threads.emplace_back(worker);
+        for (auto& t : threads) t.join();
+    }
+
+    return results;
+}
+
+// Read a manifest, verify every entry and report one line per entry.
+// Returns kCheckAllOk, kCheckMismatch or kCheckManifestError.
+int checkManifest(const fs::path& manifestPath, unsigned jobs, bool failFast, std::size_t bufferSize,
+                  ProgressMeter* progress) {
+    std::ifstream manifest(manifestPath);
+    if (!manifest.is_open()) {
+        std::cerr << "ERROR: Unable to open manifest: " << manifestPath.string() << "\n";
+        return kCheckManifestError;
+    }
+
+    std::vector<ManifestEntry> entries;
+    size_t malformed = 0;
+    size_t lineNumber = 0;
+    std::string line;
+
+    while (std::getline(manifest, line)) {
+        ++lineNumber;
+        if (line.empty() || line == "\r") continue;
+
+        ManifestEntry entry;
+        if (parseManifestLine(line, lineNumber, entry)) {
+            entries.push_back(std::move(entry));
+        } else {
+            ++malformed;
+        }
+    }
+
+    if (entries.empty()) {
+        std::cerr << "ERROR: No properly formatted SHA-256 lines found in " << manifestPath.string() << "\n";
+        return kCheckManifestError;
+    }
+
+    std::vector<CheckResult> results = verifyManifestEntries(entries, jobs, failFast, bufferSize, progress);
+
+    size_t failed = 0;
+    size_t missing = 0;
+    size_t skipped = 0;
+
+    for (const auto& r : results) {
+        switch (r.status) {
+            case CheckStatus::Ok:
+                std::cout << r.entry.path.string() << ": OK\n";
+                break;
+            case CheckStatus::Failed:
+                ++failed;
+                std::cout << r.entry.path.string() << ": FAILED\n";
+                break;
+            case CheckStatus::Missing:
+                ++missing;
+                std::cout << r.entry.path.string() << ": MISSING\n";
+                break;
+            case CheckStatus::Skipped:
+                ++skipped;
+                break;
         }
     }
+
+    if (malformed > 0)
+        std::cerr << "WARNING: " << malformed << " line(s) improperly formatted\n";
+    if (missing > 0)
+        std::cerr << "WARNING: " << missing << " listed file(s) missing or unreadable\n";
+    if (failed > 0)
+        std::cerr << "WARNING: " << failed << " computed checksum(s) did NOT match\n";
+    if (skipped > 0)
+        std::cerr << "WARNING: " << skipped << " file(s) not checked (--fail-fast)\n";
+
+    return (failed > 0 || missing > 0) ? kCheckMismatch : kCheckAllOk;
 }
 
 // HashCommand::run()
@@ -91,16 +543,52 @@ void HashCommand::run() const {
 
     fs::path path(targetPath);
 
+    // Stopped (final totals printed) when run() returns
+    std::unique_ptr<ProgressMeter> meter;
+    if (progress) {
+        meter = std::make_unique<ProgressMeter>("hash");
+        meter->start();
+    }
+
+    // Manifest verification mode: targetPath is the manifest
+    if (check) {
+        int status = checkManifest(path, jobs, failFast, bufferSize, meter.get());
+        if (meter) meter->stop();
+        if (status != kCheckAllOk) std::exit(status);
+        return;
+    }
+
     // Does the path exist?
     if (!fs::exists(path)) {
         std::cerr << "ERROR: Path does not exist: " << targetPath << "\n";
         return;
     }
 
+    // Single file, sampled fingerprint
+    if (quick && fs::is_regular_file(path)) {
+        bool ok;
+        std::string fingerprint = quickFingerprint(path, ok);
+
+        std::cout << "File: " << fs::absolute(path).string() << "\n";
+        if (ok)
+            std::cout << "Quick fingerprint (sampled blocks only, NOT a full-content SHA-256): quick:"
+                      << fingerprint << "\n";
+        else
+            std::cout << "Quick fingerprint: <READ ERROR>\n";
+
+        return;
+    }
+
     // Single file
     if (fs::is_regular_file(path)) {
+        if (meter) {
+            std::error_code ec;
+            meter->expect(1, fs::file_size(path, ec));
+            meter->totalsKnown();
+        }
         bool ok;
-        std::string hash = hashFile(path, ok);
+        std::string hash = hashFile(path, ok, bufferSize, meter.get());
+        if (meter && ok) meter->addFiles();
 
         std::cout << "File: " << fs::absolute(path).string() << "\n";
         if (ok)
@@ -114,7 +602,9 @@ void HashCommand::run() const {
     // Directory listing
     if (fs::is_directory(path)) {
         std::cout << "Directory: " << fs::absolute(path).string() << "\n";
-        printDirectoryHashes(path, recursive, 1);
+        if (quick)
+            std::cout << "Quick fingerprints (sampled blocks only, NOT full-content SHA-256)\n";
+        printDirectoryHashes(path, recursive, 1, bufferSize, quick, meter.get());
         return;
     }
 
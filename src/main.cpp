@@ -40,6 +40,25 @@ void registerStatsCommand(CLI::App& app) {
     // Required positional arguments
     statsSub->add_option("path", statsCmd.targetPath, "File or directory to inspect")->required();
 
+    // Optional flags
+    statsSub->add_option("-j,--jobs", statsCmd.jobs, "Directories scanned concurrently (0 = one per core)");
+    statsSub->add_option("--top", statsCmd.topN, "Show the N largest files and directories in the whole tree");
+    statsSub->add_flag("--histogram", statsCmd.histogram, "Show file size and modification age histograms");
+    statsSub->add_flag("--by-extension", statsCmd.byExtension, "Show recursive file count and size per extension");
+    statsSub->add_flag("-x,--one-file-system", statsCmd.oneFileSystem, "Do not descend into other filesystems");
+    statsSub->add_option("--format", statsCmd.format, "Output format: text or ndjson (one record per file/directory)")
+        ->check(CLI::IsMember({"text", "ndjson"}));
+    statsSub->add_flag("--sorted", statsCmd.sorted, "Order ndjson records by path (bounded external sort)");
+    statsSub->add_flag("--lines", statsCmd.lines, "Count lines per file, extension and directory");
+    statsSub->add_flag("--words", statsCmd.words, "Also count words (implies --lines)");
+    auto estimateFlag =
+        statsSub->add_flag("--estimate", statsCmd.estimate, "Estimate totals by random sampling instead of a full walk");
+    statsSub->add_option("--estimate-samples", statsCmd.estimateSamples, "Stop estimating after N samples (0 = no limit)")
+        ->needs(estimateFlag);
+    statsSub->add_option("--estimate-time", statsCmd.estimateSeconds, "Stop estimating after SECONDS (0 = no limit)")
+        ->capture_default_str()
+        ->needs(estimateFlag);
+
     // CLI11 callback calls run() on StatsCommand struct
     statsSub->callback([&]() { statsCmd.run(); });
 }
@@ -51,10 +70,20 @@ void registerHashCommand(CLI::App& app) {
     auto hashSub = app.add_subcommand("hash", "Compute SHA-256 hash values for files in a directory");
 
     // Require positional arguments
-    hashSub->add_option("path", hashCmd.targetPath, "File or directory to hash")->required();
+    hashSub->add_option("path", hashCmd.targetPath, "File or directory to hash (manifest with --check)")->required();
 
     // Optional flags
     hashSub->add_flag("-r,--recursive", hashCmd.recursive, "Enable recursive directory hashing");
+    auto checkFlag = hashSub->add_flag("-c,--check", hashCmd.check, "Verify files listed in a sha256sum-format manifest");
+    hashSub->add_flag("--fail-fast", hashCmd.failFast, "Stop verifying at the first mismatch (with --check)")
+        ->needs(checkFlag);
+    hashSub->add_option("-j,--jobs", hashCmd.jobs, "Worker threads for --check (0 = one per core)")
+        ->needs(checkFlag);
+    hashSub->add_option("--buffer-size", hashCmd.bufferSize, "Read buffer size, e.g. 256K or 4M (default 1M)")
+        ->transform(CLI::AsSizeValue(false));
+    hashSub->add_flag("--quick", hashCmd.quick, "Sampled fingerprint of size + fixed blocks (not a full-content hash)")
+        ->excludes(checkFlag);
+    hashSub->add_flag("--progress", hashCmd.progress, "Show files, bytes, rate and ETA on stderr while hashing");
 
     // CLI11 callback calls run() on HashCommand struct
     hashSub->callback([&]() { hashCmd.run(); });
@@ -73,6 +102,23 @@ void registerCopyCommand(CLI::App& app) {
     // Optional flags
     copySub->add_flag("-r,--recursive", copyCmd.recursive, "Enable recursive directory copying");
     copySub->add_flag("-f,--force", copyCmd.force, "Overwrite destination files if they already exist");
+    copySub->add_flag("-v,--verbose", copyCmd.verbose, "Report how each file was copied");
+    copySub->add_option("--reflink", copyCmd.reflink, "Copy-on-write clones: auto, always or never")
+        ->check(CLI::IsMember({"auto", "always", "never"}));
+    copySub->add_option("-j,--jobs", copyCmd.jobs, "Files copied concurrently with --recursive (0 = one per core)");
+    copySub->add_flag("-u,--update", copyCmd.update, "Skip files whose size and modification time match");
+    copySub->add_flag("-c,--checksum", copyCmd.checksum, "Skip files whose size and contents match");
+    copySub->add_flag("--delete", copyCmd.deleteExtraneous, "Delete destination entries not present in the source");
+    copySub->add_flag("--delta", copyCmd.delta, "Rewrite only the changed blocks of existing destination files");
+    copySub->add_flag("--progress", copyCmd.progress, "Show files, bytes, rate and ETA on stderr while copying");
+    copySub->add_flag("-H,--preserve-links", copyCmd.preserveLinks,
+                      "Recreate hard links between copied files instead of copying their data again");
+    copySub->add_flag("--verify", copyCmd.verify, "Hash data while copying, then re-read the destination and compare");
+    copySub->add_flag("--verify-direct", copyCmd.verifyDirect, "Like --verify, re-reading with O_DIRECT (bypass the cache)");
+    copySub->add_option("--manifest", copyCmd.manifest, "Write a sha256sum-format manifest of the copied files (implies --verify)");
+    copySub->add_option("--sparse", copyCmd.sparse, "Keep holes of sparse files: auto, always or never")
+        ->check(CLI::IsMember({"auto", "always", "never"}));
+    copySub->add_flag("--direct", copyCmd.direct, "Copy with O_DIRECT so large files do not flush the page cache");
 
     // CLI11 callback calls run() on CopyCommand struct
     copySub->callback([&]() { copyCmd.run(); });
@@ -91,6 +137,9 @@ void registerMoveCommand(CLI::App& app) {
     // Optional flags
     moveSub->add_flag("-f,--force", moveCmd.force, "Overwrite if destination exists");
     moveSub->add_flag("-r,--recursive", moveCmd.recursive, "Allow recursive directory moving");
+    moveSub->add_flag("--progress", moveCmd.progress, "Show files, bytes and rate on stderr when falling back to copying");
+    moveSub->add_option("--sparse", moveCmd.sparse, "Holes when falling back to copying: auto, always or never")
+        ->check(CLI::IsMember({"auto", "always", "never"}));
 
     // CLI11 callback calls run() on MoveCommand struct
     moveSub->callback([&]() { moveCmd.run(); });
@@ -124,6 +173,24 @@ void registerTreeCommand(CLI::App& app) {
 
     // Optional flags
     treeSub->add_flag("--dirs-only", treeCmd.dirsOnly, "Display only directories");
+    treeSub->add_option("-L,--max-depth", treeCmd.maxDepth, "Descend at most N levels (0 = unlimited)");
+    treeSub->add_option("--max-entries-per-dir", treeCmd.maxEntriesPerDir,
+                        "Show at most N entries per directory, then \"... N more\" (0 = unlimited)");
+    auto duFlag = treeSub->add_flag("--du", treeCmd.du, "Annotate entries with recursive size and file count");
+    treeSub->add_option("--min-size", treeCmd.minSize, "With --du, hide entries smaller than SIZE, e.g. 10M")
+        ->transform(CLI::AsSizeValue(false))
+        ->needs(duFlag);
+    treeSub->add_option("-j,--jobs", treeCmd.jobs, "With --du, directories scanned concurrently (0 = one per core)")
+        ->needs(duFlag);
+    treeSub->add_option("-P,--pattern", treeCmd.includePattern, "List only files matching the glob, e.g. '*.c|*.h'");
+    treeSub->add_option("-I,--ignore", treeCmd.excludePattern, "Hide files and directories matching the glob");
+    treeSub->add_flag("--prune", treeCmd.prune, "Omit directories that contain no matching files")
+        ->excludes(duFlag);
+    treeSub->add_option("--sort", treeCmd.sort, "Entry order: none, name, natural, size or mtime")
+        ->check(CLI::IsMember({"none", "name", "natural", "size", "mtime"}));
+    treeSub->add_flag("--dirs-first", treeCmd.dirsFirst, "List directories before files");
+    treeSub->add_option("--prefetch", treeCmd.prefetch,
+                        "Threads listing upcoming directories ahead of output, for NFS and other slow filesystems");
 
     // CLI11 callback calls run() on TreeCommand struct
     treeSub->callback([&]() { treeCmd.run(); });
@@ -1,20 +1,62 @@
 #include "../include/move_tool.h"
+#include "../include/progress.h"
 
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <system_error>
 
 namespace fs = std::filesystem;
 
-// Copy + delete fallback for recursive directory move
+// Copy a directory tree for the fallback: symlinks stay links, and files go
+// through copyFileData so sparse files keep their holes
+static bool copyTree(const fs::path& source, const fs::path& destination, SparseMode sparse,
+                     ProgressMeter* progress, std::error_code& ec) {
+    fs::create_directory(destination, source, ec);
+    if (ec) return false;
+
+    for (fs::recursive_directory_iterator it(source, ec), end; !ec && it != end; it.increment(ec)) {
+        const fs::path target = destination / it->path().lexically_relative(source);
+        const fs::file_status status = it->symlink_status(ec);
+        if (ec) return false;
+
+        if (fs::is_symlink(status)) {
+            fs::copy_symlink(it->path(), target, ec);
+        } else if (fs::is_directory(status)) {
+            fs::create_directory(target, it->path(), ec);
+        } else if (fs::is_regular_file(status)) {
+            if (progress) progress->setCurrent(it->path());
+            copyFileData(it->path(), target, ReflinkMode::Auto, sparse, ec, progress);
+            if (progress && !ec) progress->addFiles();
+        } else {
+            fs::copy(it->path(), target, ec);
+        }
+        if (ec) return false;
+    }
+    return !ec;
+}
+
 bool moveRecursive(
     const fs::path& source,
     const fs::path& destination,
     bool force,
     bool recursive,
     std::string& errorMessage
+) {
+    return moveRecursive(source, destination, force, recursive, SparseMode::Auto, errorMessage);
+}
+
+// Copy + delete fallback for recursive directory move
+bool moveRecursive(
+    const fs::path& source,
+    const fs::path& destination,
+    bool force,
+    bool recursive,
+    SparseMode sparse,
+    std::string& errorMessage,
+    ProgressMeter* progress
 ) {
     // If attempting to move a directory but recursive is not enabled
     if (!recursive && fs::is_directory(source)) {
@@ -41,22 +83,19 @@ bool moveRecursive(
     // First copy
     std::error_code cp_ec;
     if (fs::is_directory(source)) {
-        fs::copy(
-            source,
-            destination,
-            fs::copy_options::recursive | fs::copy_options::overwrite_existing,
-            cp_ec
-        );
+        copyTree(source, destination, sparse, progress, cp_ec);
     } else {
-        fs::copy_file(
-            source,
-            destination,
-            force ? fs::copy_options::overwrite_existing : fs::copy_options::none,
-            cp_ec
-        );
+        if (progress) {
+            progress->expect(1, fs::file_size(source, cp_ec));
+            progress->totalsKnown();
+            progress->setCurrent(source);
+        }
+        copyFileData(source, destination, ReflinkMode::Auto, sparse, cp_ec, progress);
+        if (progress && !cp_ec) progress->addFiles();
     }
 
     if (cp_ec) {
+        if (progress) progress->addError();
         errorMessage = "Copy failed: " + cp_ec.message();
         return false;
     }
@@ -77,6 +116,12 @@ void MoveCommand::run() const {
     fs::path src(sourcePath);
     fs::path dst(destinationPath);
 
+    SparseMode sparseMode;
+    if (!parseSparseMode(sparse, sparseMode)) {
+        std::cerr << "Error: Unknown --sparse mode \"" << sparse << "\" (use auto, always or never)\n";
+        return;
+    }
+
     if (!fs::exists(src)) {
         std::cerr << "Error: Source does not exist.\n";
         return;
@@ -91,9 +136,14 @@ void MoveCommand::run() const {
         return;
     }
 
-    // If rename failed, attempt fallback
+    // If rename failed, attempt fallback (final totals printed when run() returns)
+    std::unique_ptr<ProgressMeter> meter;
+    if (progress) {
+        meter = std::make_unique<ProgressMeter>("move");
+        meter->start();
+    }
     std::string errorMessage;
-    if (!moveRecursive(src, dst, force, recursive, errorMessage)) {
+    if (!moveRecursive(src, dst, force, recursive, sparseMode, errorMessage, meter.get())) {
         std::cerr << "Error: " << errorMessage << "\n";
         return;
     }
@@ -1,15 +1,42 @@
 #include "../include/stats_tool.h"
+#include "../include/work_stealing.h"
+#include "../include/file_identity.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
 #include <cstdint>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
 #include <filesystem>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <mutex>
+#include <queue>
+#include <random>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace fs = std::filesystem;
 
 // Get the size of files and directories (human-readable)
@@ -44,80 +71,1091 @@ std::string formatFileTime(const fs::file_time_type& ft) {
     return std::string(buf);
 }
 
-// Compute recursive totals for a directory (files, dirs, total size)
-DirectoryTotals computeDirectoryTotals(const std::string& directory) {
-    DirectoryTotals totals{0, 0, 0};
-    try {
-        fs::directory_options opts = fs::directory_options::skip_permission_denied;
-        for (const auto& entry : fs::recursive_directory_iterator(directory, opts)) {
-            std::error_code ec;
-            if (entry.is_regular_file(ec) && !ec) {
-                ++totals.totalFiles;
-                std::uintmax_t s = 0;
-                std::error_code e2;
-                s = fs::file_size(entry.path(), e2);
-                if (!e2) totals.totalSize += s;
-            } else if (entry.is_directory(ec) && !ec) {
-                ++totals.totalDirs;
+static bool isWordSpace(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Count newlines, and optionally words, in a buffer. With SSE2 the buffer is
+// processed 16 bytes per step: newline matches are summed in byte lanes and
+// folded with _mm_sad_epu8, and word starts are found from the whitespace
+// bitmask (a non-space byte whose predecessor is a space).
+void countText(const unsigned char* data, std::size_t length, bool countWords, TextCounts& counts) {
+    std::size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+
+    if (!countWords) {
+        while (i + 16 <= length) {
+            // Byte lanes overflow after 255 steps, so flush at least that often
+            __m128i acc = _mm_setzero_si128();
+            const std::size_t steps = std::min<std::size_t>((length - i) / 16, 255);
+            for (std::size_t k = 0; k < steps; ++k, i += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, newline));
             }
+            __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+            counts.lines += static_cast<std::uintmax_t>(_mm_cvtsi128_si32(sums)) +
+                            static_cast<std::uintmax_t>(_mm_extract_epi16(sums, 4));
         }
-    } catch (const fs::filesystem_error& e) {
-        std::cerr << "Filesystem error while computing totals: " << e.what() << std::endl;
+    } else {
+        const __m128i space = _mm_set1_epi8(' ');
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i four = _mm_set1_epi8(4);
+        std::uint32_t prevInWord = counts.inWord ? 1u : 0u;
+
+        for (; i + 16 <= length; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            counts.lines += static_cast<std::uintmax_t>(
+                std::popcount(static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)))));
+
+            // \t..\r is (c - 9) <= 4 unsigned, i.e. min(c - 9, 4) == c - 9
+            __m128i shifted = _mm_sub_epi8(v, tab);
+            __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(shifted, four), shifted);
+            __m128i blank = _mm_or_si128(control, _mm_cmpeq_epi8(v, space));
+
+            std::uint32_t inWord = ~static_cast<std::uint32_t>(_mm_movemask_epi8(blank)) & 0xFFFFu;
+            std::uint32_t starts = inWord & ~((inWord << 1) | prevInWord);
+            counts.words += static_cast<std::uintmax_t>(std::popcount(starts));
+            prevInWord = inWord >> 15;
+        }
+        counts.inWord = prevInWord != 0;
     }
-    return totals;
-}
+#endif
 
-std::vector<FileSummary> listImmediateFiles(const std::string& directory) {
-    std::vector<FileSummary> out;
-    try {
-        fs::directory_options opts = fs::directory_options::skip_permission_denied;
-        for (const auto& entry : fs::directory_iterator(directory, opts)) {
-            std::error_code ec;
-            if (!entry.is_regular_file(ec) || ec) continue;
-            std::uintmax_t s = 0;
-            std::error_code e2;
-            s = fs::file_size(entry.path(), e2);
-            if (e2) s = 0;
-            FileSummary f;
-            f.filename = entry.path().filename().string();
-            f.extension = entry.path().extension().string();
-            f.size = s;
-            out.push_back(std::move(f));
+    for (; i < length; ++i) {
+        const unsigned char c = data[i];
+        if (c == '\n') ++counts.lines;
+        if (countWords) {
+            const bool blank = isWordSpace(c);
+            if (!blank && !counts.inWord) ++counts.words;
+            counts.inWord = !blank;
         }
-    } catch (const fs::filesystem_error& e) {
-        std::cerr << "Filesystem error while listing files: " << e.what() << std::endl;
     }
-    // Sort by extension then filename for deterministic output
-    std::sort(out.begin(), out.end(), [](const FileSummary& a, const FileSummary& b){
-        if (a.extension != b.extension) return a.extension < b.extension;
-        return a.filename < b.filename;
+}
+
+// Count lines (and words) of a file through a per-thread 256 KB buffer
+bool countFileText(const fs::path& path, bool countWords, TextCounts& counts) {
+    thread_local std::vector<unsigned char> buffer(256 * 1024);
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    while (file) {
+        file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        const std::streamsize n = file.gcount();
+        if (n <= 0) break;
+        countText(buffer.data(), static_cast<std::size_t>(n), countWords, counts);
+    }
+    return !file.bad();
+}
+
+void FileListing::add(std::string_view filename, std::string_view extension, std::uintmax_t size,
+                      std::uintmax_t lines, std::uintmax_t words) {
+    auto [it, inserted] = m_extensionIndex.try_emplace(std::string(extension),
+                                                       static_cast<std::uint32_t>(m_extensions.size()));
+    if (inserted) m_extensions.emplace_back(extension);
+
+    m_order.push_back(static_cast<std::uint32_t>(m_sizes.size()));
+    m_nameOffsets.push_back(m_names.add(filename));
+    m_nameLengths.push_back(static_cast<std::uint32_t>(filename.size()));
+    m_extensionIds.push_back(it->second);
+    m_sizes.push_back(size);
+    m_lines.push_back(lines);
+    m_words.push_back(words);
+}
+
+void FileListing::sort() {
+    // Rank the distinct extensions once so entries compare by integer first
+    std::vector<std::uint32_t> byName(m_extensions.size());
+    for (std::uint32_t id = 0; id < byName.size(); ++id) byName[id] = id;
+    std::sort(byName.begin(), byName.end(),
+              [this](std::uint32_t a, std::uint32_t b) { return m_extensions[a] < m_extensions[b]; });
+    std::vector<std::uint32_t> rank(m_extensions.size());
+    for (std::uint32_t r = 0; r < byName.size(); ++r) rank[byName[r]] = r;
+
+    std::sort(m_order.begin(), m_order.end(), [&](std::uint32_t a, std::uint32_t b) {
+        const std::uint32_t ra = rank[m_extensionIds[a]];
+        const std::uint32_t rb = rank[m_extensionIds[b]];
+        if (ra != rb) return ra < rb;
+        return m_names.view(m_nameOffsets[a], m_nameLengths[a]) < m_names.view(m_nameOffsets[b], m_nameLengths[b]);
+    });
+}
+
+FileEntry FileListing::operator[](std::size_t i) const {
+    const std::uint32_t row = m_order[i];
+    return FileEntry{m_names.view(m_nameOffsets[row], m_nameLengths[row]), m_extensions[m_extensionIds[row]],
+                     m_sizes[row], m_lines[row], m_words[row]};
+}
+
+std::size_t SubdirListing::add(std::string_view dirpath) {
+    const std::size_t row = m_totalSizes.size();
+    m_order.push_back(static_cast<std::uint32_t>(row));
+    m_pathOffsets.push_back(m_paths.add(dirpath));
+    m_pathLengths.push_back(static_cast<std::uint32_t>(dirpath.size()));
+    m_totalSizes.push_back(0);
+    m_fileCounts.push_back(0);
+    m_allocatedSizes.push_back(0);
+    m_lineCounts.push_back(0);
+    return row;
+}
+
+void SubdirListing::setTotals(std::size_t index, std::uintmax_t totalSize, std::size_t fileCount,
+                              std::uintmax_t allocatedSize, std::uintmax_t lineCount) {
+    m_totalSizes[index] = totalSize;
+    m_fileCounts[index] = fileCount;
+    m_allocatedSizes[index] = allocatedSize;
+    m_lineCounts[index] = lineCount;
+}
+
+void SubdirListing::sort() {
+    std::sort(m_order.begin(), m_order.end(), [this](std::uint32_t a, std::uint32_t b) {
+        return m_paths.view(m_pathOffsets[a], m_pathLengths[a]) < m_paths.view(m_pathOffsets[b], m_pathLengths[b]);
     });
+}
+
+SubdirEntry SubdirListing::operator[](std::size_t i) const {
+    const std::uint32_t row = m_order[i];
+    return SubdirEntry{m_paths.view(m_pathOffsets[row], m_pathLengths[row]), m_totalSizes[row], m_fileCounts[row],
+                       m_allocatedSizes[row], m_lineCounts[row]};
+}
+
+// Sort immediate listings for deterministic output
+static void sortReport(StatsReport& report) {
+    // Files by extension then filename, subdirectories by name
+    report.files.sort();
+    report.subdirs.sort();
+}
+
+namespace {
+
+constexpr std::size_t kSizeBuckets = 65;   // 0 B, then [2^(k-1), 2^k) for k = 1..64
+constexpr std::size_t kAgeBuckets = std::size(kAgeBucketBounds);
+constexpr std::size_t kNdjsonFlushBytes = 64 * 1024;          // per-worker record buffer
+constexpr std::size_t kNdjsonSortRunBytes = 64 * 1024 * 1024; // in-memory sort run
+
+struct BucketCounter {
+    std::uintmax_t files = 0;
+    std::uintmax_t bytes = 0;
+    std::uintmax_t lines = 0;
+    std::uintmax_t words = 0;
+};
+
+// Bounded min-heap keeping the n largest entries seen. wants() is checked
+// before building the path string so small files cost one comparison.
+class TopN {
+public:
+    explicit TopN(std::size_t n) : m_limit(n) { m_heap.reserve(n); }
+
+    bool wants(std::uintmax_t size) const {
+        return m_limit > 0 && (m_heap.size() < m_limit || size > m_heap.front().size);
+    }
+
+    void add(std::string path, std::uintmax_t size) {
+        if (m_heap.size() == m_limit) {
+            std::pop_heap(m_heap.begin(), m_heap.end(), greater);
+            m_heap.pop_back();
+        }
+        m_heap.push_back({std::move(path), size});
+        std::push_heap(m_heap.begin(), m_heap.end(), greater);
+    }
+
+    std::vector<SizeEntry>& entries() { return m_heap; }
+
+private:
+    static bool greater(const SizeEntry& a, const SizeEntry& b) { return a.size > b.size; }
+
+    std::size_t m_limit;
+    std::vector<SizeEntry> m_heap;
+};
+
+// Escape a string for use inside a JSON string literal
+std::string jsonEscape(const std::string& in) {
+    std::string out;
+    out.reserve(in.size() + 2);
+    for (unsigned char c : in) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
     return out;
 }
 
-std::vector<SubdirSummary> listImmediateSubdirs(const std::string& directory) {
-    std::vector<SubdirSummary> out;
-    try {
-        fs::directory_options opts = fs::directory_options::skip_permission_denied;
-        for (const auto& entry : fs::directory_iterator(directory, opts)) {
-            std::error_code ec;
-            if (!entry.is_directory(ec) || ec) continue;
-            SubdirSummary s;
-            s.dirpath = entry.path().string();
-            // Compute totals for this subdir recursively
-            DirectoryTotals dt = computeDirectoryTotals(entry.path().string());
-            s.totalSize = dt.totalSize;
-            s.fileCount = dt.totalFiles;
-            out.push_back(std::move(s));
+// Receives NDJSON chunks from the workers. Unsorted output goes straight to
+// the stream. Sorted output is an external merge sort: lines are buffered
+// up to kNdjsonSortRunBytes, spilled to sorted run files, and k-way merged
+// at the end, so memory stays bounded however many records there are.
+// In sorted mode every line is "<escaped path>\t<json>" and the key is
+// dropped on output.
+class NdjsonSink {
+public:
+    NdjsonSink(std::ostream& out, bool sorted) : m_out(out), m_sorted(sorted) {}
+
+    ~NdjsonSink() {
+        std::error_code ec;
+        if (!m_runDir.empty()) fs::remove_all(m_runDir, ec);
+    }
+
+    // Consume a chunk of complete lines (the chunk is cleared)
+    void write(std::string& chunk) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_sorted) {
+            m_out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        } else if (m_error.empty()) {
+            // After a failed spill the sorted output is lost anyway, so
+            // records are dropped instead of piling up in memory
+            size_t start = 0;
+            while (start < chunk.size()) {
+                size_t end = chunk.find('\n', start);
+                m_bytes += end - start + sizeof(std::string);
+                m_lines.emplace_back(chunk, start, end - start);
+                start = end + 1;
+            }
+            if (m_bytes >= kNdjsonSortRunBytes) spillRun();
         }
-    } catch (const fs::filesystem_error& e) {
-        std::cerr << "Filesystem error while listing subdirectories: " << e.what() << std::endl;
+        chunk.clear();
     }
-    // Sort by name
-    std::sort(out.begin(), out.end(), [](const SubdirSummary& a, const SubdirSummary& b){
-        return a.dirpath < b.dirpath;
+
+    bool sorted() const { return m_sorted; }
+
+    // Emit everything buffered (merging sorted runs if there are any). Runs
+    // on the calling thread once the walk has joined, so a spill failure
+    // recorded by a worker is thrown from here.
+    void finish() {
+        if (!m_sorted) return;
+        if (!m_error.empty()) throw std::runtime_error(m_error);
+        if (m_runs.empty()) {
+            std::sort(m_lines.begin(), m_lines.end(), keyLess);
+            for (const auto& line : m_lines) emit(line);
+            m_lines.clear();
+            return;
+        }
+        if (!m_lines.empty()) spillRun();
+        if (!m_error.empty()) throw std::runtime_error(m_error);
+        mergeRuns();
+    }
+
+private:
+    static std::string_view key(const std::string& line) {
+        return std::string_view(line).substr(0, line.find('\t'));
+    }
+
+    static bool keyLess(const std::string& a, const std::string& b) {
+        return key(a) < key(b);
+    }
+
+    void emit(const std::string& line) {
+        size_t tab = line.find('\t');
+        m_out.write(line.data() + tab + 1, static_cast<std::streamsize>(line.size() - tab - 1));
+        m_out.put('\n');
+    }
+
+    // Runs live in a directory only this sink can have created (mkdtemp,
+    // mode 0700), so concurrent runs cannot collide and nobody can plant a
+    // file or symlink under a run's name
+    static fs::path makeRunDirectory(std::error_code& ec) {
+        const fs::path base = fs::temp_directory_path(ec);
+        if (ec) return {};
+#if !defined(_WIN32)
+        std::string templ = (base / "toolkit-stats-XXXXXX").string();
+        if (::mkdtemp(templ.data()) == nullptr) {
+            ec = std::error_code(errno, std::generic_category());
+            return {};
+        }
+        return templ;
+#else
+        std::random_device rd;
+        for (int attempt = 0; attempt < 100; ++attempt) {
+            fs::path dir = base / ("toolkit-stats-" + std::to_string(rd()) + std::to_string(rd()));
+            if (fs::create_directory(dir, ec)) return dir;
+            if (ec) return {};
+        }
+        ec = std::make_error_code(std::errc::file_exists);
+        return {};
+#endif
+    }
+
+    // Called with m_mutex held, possibly on a walk worker: failures are
+    // recorded in m_error (first one wins) rather than thrown
+    void spillRun() {
+        std::error_code ec;
+        if (m_runDir.empty()) m_runDir = makeRunDirectory(ec);
+        if (m_runDir.empty()) {
+            m_error = "unable to create a sort run directory: " + ec.message();
+        } else {
+            std::sort(m_lines.begin(), m_lines.end(), keyLess);
+            fs::path run = m_runDir / (std::to_string(m_runs.size()) + ".run");
+            std::ofstream ofs(run, std::ios::binary | std::ios::trunc);
+            for (const auto& line : m_lines) ofs << line << '\n';
+            ofs.close();
+            if (ofs) {
+                m_runs.push_back(run);
+            } else {
+                m_error = "unable to write sort run " + run.string();
+            }
+        }
+        m_lines.clear();
+        m_lines.shrink_to_fit();
+        m_bytes = 0;
+    }
+
+    void mergeRuns() {
+        struct Head {
+            std::string line;
+            size_t run;
+        };
+        auto greater = [](const Head& a, const Head& b) { return keyLess(b.line, a.line); };
+        std::priority_queue<Head, std::vector<Head>, decltype(greater)> heap(greater);
+
+        std::vector<std::ifstream> inputs;
+        inputs.reserve(m_runs.size());
+        for (size_t i = 0; i < m_runs.size(); ++i) {
+            inputs.emplace_back(m_runs[i], std::ios::binary);
+            Head h{std::string(), i};
+            if (std::getline(inputs[i], h.line)) heap.push(std::move(h));
+        }
+
+        while (!heap.empty()) {
+            Head h = heap.top();
+            heap.pop();
+            emit(h.line);
+            if (std::getline(inputs[h.run], h.line)) heap.push(std::move(h));
+        }
+    }
+
+    std::ostream& m_out;
+    bool m_sorted;
+    std::mutex m_mutex;
+    std::vector<std::string> m_lines;
+    size_t m_bytes = 0;
+    fs::path m_runDir;
+    std::vector<fs::path> m_runs;
+    std::string m_error;          // first spill failure, reported by finish()
+};
+
+// Per-worker accumulators, merged once the walk is done
+struct alignas(64) WorkerStats {
+    explicit WorkerStats(std::size_t topN) : topFiles(topN), topDirs(topN) {}
+
+    TopN topFiles;
+    TopN topDirs;
+    std::array<BucketCounter, kSizeBuckets> sizes{};
+    std::array<BucketCounter, kAgeBuckets> ages{};
+    std::unordered_map<std::string, BucketCounter> extensions;
+    std::string ndjson;   // pending NDJSON records for the sink
+};
+
+std::size_t sizeBucket(std::uintmax_t size) {
+    return static_cast<std::size_t>(std::bit_width(size));
+}
+
+std::size_t ageBucket(std::uintmax_t ageSeconds) {
+    std::size_t i = 0;
+    while (i + 1 < kAgeBuckets && ageSeconds >= kAgeBucketBounds[i]) ++i;
+    return i;
+}
+
+// Merge per-worker top-N heaps into one descending list of at most n entries
+std::vector<SizeEntry> mergeTopN(std::vector<WorkerStats>& workers, TopN WorkerStats::*member, std::size_t n) {
+    std::vector<SizeEntry> all;
+    for (auto& w : workers) {
+        auto& entries = (w.*member).entries();
+        std::move(entries.begin(), entries.end(), std::back_inserter(all));
+    }
+    std::sort(all.begin(), all.end(), [](const SizeEntry& a, const SizeEntry& b) {
+        if (a.size != b.size) return a.size > b.size;
+        return a.path < b.path;
     });
-    return out;
+    if (all.size() > n) all.resize(n);
+    return all;
+}
+
+// Metadata for one file, from a single stat call where available
+struct FileMeta {
+    std::uintmax_t size = 0;
+    std::uintmax_t allocated = 0;     // bytes actually allocated on disk
+    std::uintmax_t links = 1;
+    FileId id;
+    std::chrono::system_clock::time_point mtime;
+    bool hasMtime = false;
+};
+
+void readFileMeta(const fs::directory_entry& entry, FileMeta& meta) {
+#if !defined(_WIN32)
+    struct stat st;
+    if (::stat(entry.path().c_str(), &st) != 0) return;
+    meta.size = static_cast<std::uintmax_t>(st.st_size);
+    meta.allocated = static_cast<std::uintmax_t>(st.st_blocks) * 512;
+    meta.links = static_cast<std::uintmax_t>(st.st_nlink);
+    meta.id = FileId{static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino)};
+    meta.mtime = std::chrono::system_clock::from_time_t(st.st_mtime);
+    meta.hasMtime = true;
+#else
+    std::error_code ec;
+    meta.size = entry.file_size(ec);
+    if (ec) meta.size = 0;
+    meta.allocated = meta.size;
+    auto ft = entry.last_write_time(ec);
+    if (!ec) {
+        meta.mtime = std::chrono::time_point_cast<std::chrono::system_clock::duration>
+            (ft - fs::file_time_type::clock::now() + std::chrono::system_clock::now());
+        meta.hasMtime = true;
+    }
+#endif
+}
+
+// Device a directory lives on (0 if unknown)
+std::uint64_t deviceOf(const fs::path& path) {
+#if !defined(_WIN32)
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0) return static_cast<std::uint64_t>(st.st_dev);
+#else
+    (void)path;
+#endif
+    return 0;
+}
+
+// Recursive totals of one immediate subdirectory, filled in when its
+// subtree completes
+struct SubdirTotals {
+    std::uintmax_t totalSize = 0;
+    std::size_t fileCount = 0;
+    std::uintmax_t allocatedSize = 0;
+    std::uintmax_t lineCount = 0;
+};
+
+// One directory of the walk. A node stays alive until its own listing and
+// all of its subdirectories are done, then folds its totals into its parent.
+struct DirNode {
+    fs::path path;
+    DirNode* parent = nullptr;
+    SubdirTotals* summary = nullptr;    // set for immediate subdirectories
+    bool foldIntoParent = true;
+    bool isRoot = false;
+
+    std::atomic<std::uintmax_t> files{0};
+    std::atomic<std::uintmax_t> dirs{0};
+    std::atomic<std::uintmax_t> bytes{0};
+    std::atomic<std::uintmax_t> allocated{0};
+    std::atomic<std::uintmax_t> duplicates{0};
+    std::atomic<std::uintmax_t> lines{0};
+    std::atomic<std::uintmax_t> words{0};
+    std::atomic<std::size_t> pending{1};  // own listing + unfinished children
+};
+
+struct StatsWalk {
+    const StatsOptions& options;
+    WorkStealingPool<DirNode*> pool;
+    StatsReport& report;
+    std::deque<SubdirTotals> subdirs;   // stable addresses for DirNode::summary
+    std::vector<WorkerStats> workers;
+    FileIdSet seenLinks;           // inodes with more than one link already counted
+    std::uint64_t rootDevice = 0;  // for --one-file-system
+    NdjsonSink* sink = nullptr;    // streaming mode: records instead of listings
+    const std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
+
+    StatsWalk(const StatsOptions& opts, unsigned jobs, StatsReport& r)
+        : options(opts), pool(jobs), report(r), workers(pool.size(), WorkerStats(opts.topN)) {}
+
+    // ",lines,words" NDJSON fields when text counting is enabled
+    std::string textFields(std::uintmax_t lines, std::uintmax_t words) const {
+        std::string out;
+        if (options.countLines || options.countWords) out += ",\"lines\":" + std::to_string(lines);
+        if (options.countWords) out += ",\"words\":" + std::to_string(words);
+        return out;
+    }
+
+    // Queue one NDJSON record on the worker's buffer, handing full buffers
+    // to the sink
+    void record(WorkerStats& stats, const std::string& escapedPath, const std::string& json) {
+        if (sink->sorted()) {
+            stats.ndjson += escapedPath;
+            stats.ndjson += '\t';
+        }
+        stats.ndjson += json;
+        stats.ndjson += '\n';
+        if (stats.ndjson.size() >= kNdjsonFlushBytes) sink->write(stats.ndjson);
+    }
+
+    // Drop one pending reference; the last one finalizes the node and
+    // propagates to the parent. Lock-free: totals are atomics and each
+    // summary slot is written by exactly one node.
+    void release(DirNode* node, unsigned worker) {
+        while (node && node->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            const std::uintmax_t files = node->files.load(std::memory_order_relaxed);
+            const std::uintmax_t dirs = node->dirs.load(std::memory_order_relaxed);
+            const std::uintmax_t bytes = node->bytes.load(std::memory_order_relaxed);
+            const std::uintmax_t allocated = node->allocated.load(std::memory_order_relaxed);
+            const std::uintmax_t duplicates = node->duplicates.load(std::memory_order_relaxed);
+            const std::uintmax_t lines = node->lines.load(std::memory_order_relaxed);
+            const std::uintmax_t words = node->words.load(std::memory_order_relaxed);
+
+            if (node->summary) {
+                node->summary->lineCount = lines;
+                node->summary->totalSize = bytes;
+                node->summary->allocatedSize = allocated;
+                node->summary->fileCount = static_cast<std::size_t>(files);
+            }
+            if (!node->isRoot && workers[worker].topDirs.wants(bytes)) {
+                workers[worker].topDirs.add(node->path.string(), bytes);
+            }
+            if (sink) {
+                std::string path = jsonEscape(node->path.string());
+                record(workers[worker], path,
+                       "{\"type\":\"dir\",\"path\":\"" + path +
+                       "\",\"files\":" + std::to_string(files) +
+                       ",\"dirs\":" + std::to_string(dirs) +
+                       ",\"size\":" + std::to_string(bytes) +
+                       ",\"allocated\":" + std::to_string(allocated) +
+                       textFields(lines, words) + "}");
+            }
+            if (node->isRoot) {
+                report.totals = DirectoryTotals{static_cast<std::size_t>(files),
+                                                static_cast<std::size_t>(dirs), bytes,
+                                                allocated, static_cast<std::size_t>(duplicates),
+                                                lines, words};
+            }
+
+            DirNode* parent = node->parent;
+            if (parent && node->foldIntoParent) {
+                parent->files.fetch_add(files, std::memory_order_relaxed);
+                parent->dirs.fetch_add(dirs, std::memory_order_relaxed);
+                parent->bytes.fetch_add(bytes, std::memory_order_relaxed);
+                parent->allocated.fetch_add(allocated, std::memory_order_relaxed);
+                parent->duplicates.fetch_add(duplicates, std::memory_order_relaxed);
+                parent->lines.fetch_add(lines, std::memory_order_relaxed);
+                parent->words.fetch_add(words, std::memory_order_relaxed);
+            }
+            delete node;
+            node = parent;
+        }
+    }
+
+    // List one directory: count files locally, spawn a task per subdirectory
+    void process(DirNode* node, unsigned worker) {
+        const fs::directory_options opts = fs::directory_options::skip_permission_denied;
+        std::uintmax_t files = 0;
+        std::uintmax_t dirs = 0;
+        std::uintmax_t bytes = 0;
+        std::uintmax_t allocated = 0;
+        std::uintmax_t duplicates = 0;
+        std::uintmax_t lines = 0;
+        std::uintmax_t words = 0;
+        WorkerStats& stats = workers[worker];
+        const bool wantText = options.countLines || options.countWords;
+
+        std::error_code ec;
+        fs::directory_iterator it(node->path, opts, ec);
+        if (ec && node->isRoot) {
+            std::cerr << "Filesystem error while scanning directory: " << ec.message() << std::endl;
+        }
+
+        for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+            const fs::directory_entry& entry = *it;
+            std::error_code typeEc;
+
+            if (entry.is_regular_file(typeEc) && !typeEc) {
+                FileMeta meta;
+                readFileMeta(entry, meta);
+                const std::uintmax_t size = meta.size;
+
+                // Hard links: count each (device, inode) once
+                const bool duplicate = meta.links > 1 && !seenLinks.insert(meta.id);
+
+                TextCounts text;
+                if (wantText && (!duplicate || sink || node->isRoot)) {
+                    countFileText(entry.path(), options.countWords, text);
+                }
+
+                if (sink) {
+                    std::string path = jsonEscape(entry.path().string());
+                    std::string json = "{\"type\":\"file\",\"path\":\"" + path +
+                                       "\",\"size\":" + std::to_string(size) +
+                                       ",\"allocated\":" + std::to_string(meta.allocated);
+                    if (meta.hasMtime) {
+                        json += ",\"mtime\":" + std::to_string(std::chrono::duration_cast<std::chrono::seconds>(
+                                    meta.mtime.time_since_epoch()).count());
+                    }
+                    record(stats, path, json + textFields(text.lines, text.words) + "}");
+                } else if (node->isRoot) {
+                    const fs::path& p = entry.path();
+                    report.files.add(p.filename().string(), p.extension().string(), size, text.lines, text.words);
+                }
+
+                if (duplicate) {
+                    ++duplicates;
+                    continue;
+                }
+
+                ++files;
+                bytes += size;
+                allocated += meta.allocated;
+                lines += text.lines;
+                words += text.words;
+
+                if (stats.topFiles.wants(size)) {
+                    stats.topFiles.add(entry.path().string(), size);
+                }
+                if (options.histogram) {
+                    BucketCounter& sb = stats.sizes[sizeBucket(size)];
+                    ++sb.files;
+                    sb.bytes += size;
+
+                    if (meta.hasMtime) {
+                        auto age = std::chrono::duration_cast<std::chrono::seconds>(now - meta.mtime).count();
+                        BucketCounter& ab = stats.ages[ageBucket(age > 0 ? static_cast<std::uintmax_t>(age) : 0)];
+                        ++ab.files;
+                        ab.bytes += size;
+                    }
+                }
+                if (options.byExtension) {
+                    BucketCounter& ext = stats.extensions[entry.path().extension().string()];
+                    ++ext.files;
+                    ext.bytes += size;
+                    ext.lines += text.lines;
+                    ext.words += text.words;
+                }
+            } else if (entry.is_directory(typeEc) && !typeEc) {
+                ++dirs;
+
+                // Descend into real directories. Symlinked directories are
+                // counted but not followed, except that an immediate one still
+                // gets its own summary (without adding to the root totals).
+                const bool isLink = entry.is_symlink(typeEc);
+                if (isLink && !node->isRoot) continue;
+
+                // --one-file-system: count mount points but do not cross them
+                if (options.oneFileSystem && deviceOf(entry.path()) != rootDevice) continue;
+
+                auto* child = new DirNode;
+                child->path = entry.path();
+                child->parent = node;
+                child->foldIntoParent = !isLink;
+                if (node->isRoot) {
+                    report.subdirs.add(entry.path().string());
+                    subdirs.emplace_back();
+                    child->summary = &subdirs.back();
+                }
+
+                node->pending.fetch_add(1, std::memory_order_relaxed);
+                pool.push(worker, child);
+            }
+        }
+
+        node->files.fetch_add(files, std::memory_order_relaxed);
+        node->dirs.fetch_add(dirs, std::memory_order_relaxed);
+        node->bytes.fetch_add(bytes, std::memory_order_relaxed);
+        node->allocated.fetch_add(allocated, std::memory_order_relaxed);
+        node->duplicates.fetch_add(duplicates, std::memory_order_relaxed);
+        node->lines.fetch_add(lines, std::memory_order_relaxed);
+        node->words.fetch_add(words, std::memory_order_relaxed);
+        release(node, worker);
+    }
+
+    // Merge the per-worker accumulators into the report
+    void finish() {
+        report.largestFiles = mergeTopN(workers, &WorkerStats::topFiles, options.topN);
+        report.largestDirs = mergeTopN(workers, &WorkerStats::topDirs, options.topN);
+
+        if (options.histogram) {
+            for (std::size_t k = 0; k < kSizeBuckets; ++k) {
+                BucketCounter sum;
+                for (const auto& w : workers) {
+                    sum.files += w.sizes[k].files;
+                    sum.bytes += w.sizes[k].bytes;
+                }
+                const std::uintmax_t lower = k == 0 ? 0 : std::uintmax_t{1} << (k - 1);
+                const std::uintmax_t upper = k == 0 ? 1 : (k == 64 ? UINTMAX_MAX : std::uintmax_t{1} << k);
+                if (sum.files > 0) report.sizeHistogram.push_back({lower, upper, sum.files, sum.bytes});
+            }
+            for (std::size_t k = 0; k < kAgeBuckets; ++k) {
+                BucketCounter sum;
+                for (const auto& w : workers) {
+                    sum.files += w.ages[k].files;
+                    sum.bytes += w.ages[k].bytes;
+                }
+                const std::uintmax_t lower = k == 0 ? 0 : kAgeBucketBounds[k - 1];
+                report.ageHistogram.push_back({lower, kAgeBucketBounds[k], sum.files, sum.bytes});
+            }
+        }
+
+        if (options.byExtension) {
+            std::unordered_map<std::string, BucketCounter> merged;
+            for (auto& w : workers) {
+                for (auto& [ext, counter] : w.extensions) {
+                    BucketCounter& m = merged[ext];
+                    m.files += counter.files;
+                    m.bytes += counter.bytes;
+                    m.lines += counter.lines;
+                    m.words += counter.words;
+                }
+            }
+            for (auto& [ext, counter] : merged) {
+                report.extensions.push_back({ext, counter.files, counter.bytes, counter.lines, counter.words});
+            }
+            std::sort(report.extensions.begin(), report.extensions.end(),
+                      [](const ExtensionSummary& a, const ExtensionSummary& b) {
+                if (a.totalSize != b.totalSize) return a.totalSize > b.totalSize;
+                return a.extension < b.extension;
+            });
+        }
+    }
+};
+
+} // namespace
+
+// Walk a directory tree once. Every directory is a task on a work-stealing
+// pool (jobs workers; 1 = walk on the calling thread); totals are folded
+// bottom-up as subtrees finish, so the root and every immediate
+// subdirectory get recursive totals from the same traversal. File types come
+// from the cached directory entry and sizes from one stat call per file.
+// Top-N, histograms and extension totals are kept per worker in structures
+// whose size does not depend on the number of files.
+static void runWalk(const std::string& directory, const StatsOptions& options, StatsReport& report,
+                    NdjsonSink* sink) {
+    report.totals = DirectoryTotals{0, 0, 0};
+
+    unsigned jobs = options.jobs;
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    StatsWalk walk(options, jobs, report);
+    walk.sink = sink;
+    if (options.oneFileSystem) walk.rootDevice = deviceOf(directory);
+
+    auto* root = new DirNode;
+    root->path = directory;
+    root->isRoot = true;
+    walk.pool.push(0, root);
+    walk.pool.run([&walk](DirNode* node, unsigned worker) { walk.process(node, worker); });
+
+    if (sink) {
+        for (auto& w : walk.workers) {
+            if (!w.ndjson.empty()) sink->write(w.ndjson);
+        }
+    }
+
+    for (std::size_t i = 0; i < walk.subdirs.size(); ++i) {
+        const SubdirTotals& t = walk.subdirs[i];
+        report.subdirs.setTotals(i, t.totalSize, t.fileCount, t.allocatedSize, t.lineCount);
+    }
+    walk.finish();
+    sortReport(report);
+}
+
+StatsReport collectDirectoryStats(const std::string& directory, const StatsOptions& options) {
+    StatsReport report;
+    runWalk(directory, options, report, nullptr);
+    return report;
+}
+
+// Stream the tree as NDJSON: one record per file and per directory (emitted
+// when its subtree is complete), written in chunks as the walk proceeds and
+// never collected into listings. With sorted = true records are ordered by
+// path through a bounded external sort. Summary records (totals, top-N,
+// histograms, extensions) follow the stream.
+DirectoryTotals streamDirectoryStats(const std::string& directory, const StatsOptions& options,
+                                     std::ostream& out, bool sorted) {
+    StatsReport report;
+    NdjsonSink sink(out, sorted);
+    runWalk(directory, options, report, &sink);
+    sink.finish();
+
+    const DirectoryTotals& t = report.totals;
+    out << "{\"type\":\"summary\",\"path\":\"" << jsonEscape(directory)
+        << "\",\"files\":" << t.totalFiles << ",\"dirs\":" << t.totalDirs
+        << ",\"size\":" << t.totalSize << ",\"allocated\":" << t.allocatedSize
+        << ",\"duplicate_links\":" << t.duplicateLinks;
+    if (options.countLines || options.countWords) out << ",\"lines\":" << t.totalLines;
+    if (options.countWords) out << ",\"words\":" << t.totalWords;
+    out << "}\n";
+
+    for (const auto& e : report.largestFiles) {
+        out << "{\"type\":\"top_file\",\"path\":\"" << jsonEscape(e.path) << "\",\"size\":" << e.size << "}\n";
+    }
+    for (const auto& e : report.largestDirs) {
+        out << "{\"type\":\"top_dir\",\"path\":\"" << jsonEscape(e.path) << "\",\"size\":" << e.size << "}\n";
+    }
+    for (const auto& b : report.sizeHistogram) {
+        out << "{\"type\":\"size_bucket\",\"lower\":" << b.lower << ",\"upper\":" << b.upper
+            << ",\"files\":" << b.fileCount << ",\"size\":" << b.totalSize << "}\n";
+    }
+    for (const auto& b : report.ageHistogram) {
+        out << "{\"type\":\"age_bucket\",\"lower_seconds\":" << b.lower << ",\"upper_seconds\":" << b.upper
+            << ",\"files\":" << b.fileCount << ",\"size\":" << b.totalSize << "}\n";
+    }
+    for (const auto& e : report.extensions) {
+        out << "{\"type\":\"extension\",\"extension\":\"" << jsonEscape(e.extension)
+            << "\",\"files\":" << e.fileCount << ",\"size\":" << e.totalSize;
+        if (options.countLines || options.countWords) out << ",\"lines\":" << e.lines;
+        if (options.countWords) out << ",\"words\":" << e.words;
+        out << "}\n";
+    }
+    out.flush();
+    return t;
+}
+
+namespace {
+
+constexpr std::size_t kEstimateCacheDirs = 65536;
+constexpr std::size_t kEstimateExactCheckSamples = 64;
+
+// One directory as seen by the estimator; followed subdirectories follow the
+// same rules as the full walk (symlinked directories are counted, not entered)
+struct EstimateListing {
+    std::uintmax_t files = 0;
+    std::uintmax_t bytes = 0;
+    std::uintmax_t dirs = 0;
+    std::vector<std::string> descend;
+};
+
+void listForEstimate(const std::string& directory, EstimateListing& listing) {
+    std::error_code ec;
+    fs::directory_iterator it(directory, fs::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+        const fs::directory_entry& entry = *it;
+        std::error_code typeEc;
+        if (entry.is_regular_file(typeEc) && !typeEc) {
+            FileMeta meta;
+            readFileMeta(entry, meta);
+            ++listing.files;
+            listing.bytes += meta.size;
+        } else if (entry.is_directory(typeEc) && !typeEc) {
+            ++listing.dirs;
+            if (!entry.is_symlink(typeEc)) listing.descend.push_back(entry.path().string());
+        }
+    }
+}
+
+// Running mean and variance (Welford)
+struct RunningMean {
+    double mean = 0;
+    double m2 = 0;
+
+    void add(double x, std::size_t n) {
+        const double delta = x - mean;
+        mean += delta / static_cast<double>(n);
+        m2 += delta * (x - mean);
+    }
+
+    // 95% confidence half-width of the mean (normal approximation)
+    double margin(std::size_t n) const {
+        if (n < 2) return 0;
+        const double variance = m2 / static_cast<double>(n - 1);
+        return 1.96 * std::sqrt(variance / static_cast<double>(n));
+    }
+};
+
+using EstimateCache = std::unordered_map<std::string, EstimateListing>;
+
+// If the cache already holds every directory of the tree, sum it exactly
+bool exactFromCache(const EstimateCache& cache, const std::string& root, StatsEstimate& out) {
+    std::vector<const std::string*> stack{&root};
+    double files = 0, dirs = 0, bytes = 0;
+    while (!stack.empty()) {
+        auto found = cache.find(*stack.back());
+        stack.pop_back();
+        if (found == cache.end()) return false;
+        const EstimateListing& listing = found->second;
+        files += static_cast<double>(listing.files);
+        dirs += static_cast<double>(listing.dirs);
+        bytes += static_cast<double>(listing.bytes);
+        for (const auto& child : listing.descend) stack.push_back(&child);
+    }
+    out.files = files;
+    out.dirs = dirs;
+    out.bytes = bytes;
+    out.filesMargin = out.dirsMargin = out.bytesMargin = 0;
+    out.exact = true;
+    return true;
+}
+
+} // namespace
+
+// Estimate recursive totals without walking the whole tree. Each sample
+// descends from the root along one uniformly random subdirectory per level
+// and weights the counts of every directory on the path by the product of
+// the branching factors above it (Knuth's estimator), which is unbiased for
+// the tree totals. Samples are averaged until maxSamples or maxSeconds is
+// reached (0 = no limit; with neither set one sample is taken); listings are
+// memoized so upper levels are read once and later samples only pay for new
+// leaves. If sampling has read every directory the result is exact. Hard
+// links are not deduplicated.
+StatsEstimate estimateDirectoryStats(const std::string& directory, std::size_t maxSamples, double maxSeconds,
+                                     std::uint64_t seed, const EstimateProgress& progress) {
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    auto nextReport = start + std::chrono::seconds(1);
+    if (maxSamples == 0 && maxSeconds <= 0) maxSamples = 1;
+
+    if (seed == 0) seed = (static_cast<std::uint64_t>(std::random_device{}()) << 32) ^ std::random_device{}();
+    std::mt19937_64 rng(seed);
+
+    StatsEstimate result;
+    EstimateCache cache;
+    EstimateListing scratch;
+    RunningMean files, dirs, bytes;
+    std::size_t listedAtLastCheck = 0;
+
+    auto listing = [&](const std::string& path) -> const EstimateListing& {
+        auto found = cache.find(path);
+        if (found != cache.end()) return found->second;
+        ++result.directoriesRead;
+        scratch = EstimateListing{};
+        listForEstimate(path, scratch);
+        if (cache.size() >= kEstimateCacheDirs) return scratch;
+        return cache.emplace(path, std::move(scratch)).first->second;
+    };
+
+    auto snapshot = [&]() {
+        const std::size_t n = result.samples;
+        result.files = files.mean;
+        result.dirs = dirs.mean;
+        result.bytes = bytes.mean;
+        result.filesMargin = files.margin(n);
+        result.dirsMargin = dirs.margin(n);
+        result.bytesMargin = bytes.margin(n);
+    };
+
+    while (true) {
+        double weight = 1;
+        double sampleFiles = 0, sampleDirs = 0, sampleBytes = 0;
+        std::string path = directory;
+        while (true) {
+            const EstimateListing& here = listing(path);
+            sampleFiles += weight * static_cast<double>(here.files);
+            sampleDirs += weight * static_cast<double>(here.dirs);
+            sampleBytes += weight * static_cast<double>(here.bytes);
+            if (here.descend.empty()) break;
+            std::uniform_int_distribution<std::size_t> pick(0, here.descend.size() - 1);
+            weight *= static_cast<double>(here.descend.size());
+            path = here.descend[pick(rng)];
+        }
+
+        const std::size_t n = ++result.samples;
+        files.add(sampleFiles, n);
+        dirs.add(sampleDirs, n);
+        bytes.add(sampleBytes, n);
+
+        // Small trees are soon fully cached: stop sampling and sum exactly
+        if (n % kEstimateExactCheckSamples == 0) {
+            if (result.directoriesRead == listedAtLastCheck && exactFromCache(cache, directory, result)) {
+                return result;
+            }
+            listedAtLastCheck = result.directoriesRead;
+        }
+
+        if (maxSamples != 0 && n >= maxSamples) break;
+        const auto now = Clock::now();
+        if (maxSeconds > 0 && std::chrono::duration<double>(now - start).count() >= maxSeconds) break;
+        if (progress && now >= nextReport) {
+            snapshot();
+            progress(result);
+            nextReport = now + std::chrono::seconds(1);
+        }
+    }
+
+    if (!exactFromCache(cache, directory, result)) snapshot();
+    return result;
+}
+
+// Compute recursive totals for a directory (files, dirs, total size)
+DirectoryTotals computeDirectoryTotals(const std::string& directory) {
+    return collectDirectoryStats(directory).totals;
+}
+
+// Label for an age histogram bucket
+static std::string formatAgeBucket(const HistogramBucket& b) {
+    static const char* names[] = {"1 day", "1 week", "1 month", "3 months", "1 year", "3 years"};
+    const std::size_t count = std::size(names);
+
+    std::size_t upper = 0;
+    while (upper < count && kAgeBucketBounds[upper] != b.upper) ++upper;
+
+    if (upper == 0) return "< " + std::string(names[0]);
+    if (upper >= count) return "> " + std::string(names[count - 1]);
+    return std::string(names[upper - 1]) + " - " + names[upper];
+}
+
+// Print the optional whole-tree sections (top-N, histograms, extensions)
+static void printTreeSummaries(const StatsReport& report, const StatsOptions& options) {
+    if (options.topN > 0) {
+        std::cout << "\nLargest files (recursive, top " << options.topN << "):\n";
+        for (const auto& e : report.largestFiles) {
+            std::cout << "  " << formatSize(e.size) << "  " << e.path << '\n';
+        }
+        std::cout << "\nLargest directories (recursive, top " << options.topN << "):\n";
+        for (const auto& e : report.largestDirs) {
+            std::cout << "  " << formatSize(e.size) << "  " << e.path << '\n';
+        }
+    }
+
+    if (options.histogram) {
+        std::cout << "\nFile size histogram:\n";
+        for (const auto& b : report.sizeHistogram) {
+            std::string label = b.upper == 1
+                ? "0 B"
+                : "[" + formatSize(b.lower) + ", " + (b.upper == UINTMAX_MAX ? "max" : formatSize(b.upper)) + ")";
+            std::cout << "  " << std::left << std::setw(24) << label << std::right
+                      << b.fileCount << " files, " << formatSize(b.totalSize) << '\n';
+        }
+        std::cout << "\nModification age histogram:\n";
+        for (const auto& b : report.ageHistogram) {
+            std::cout << "  " << std::left << std::setw(24) << formatAgeBucket(b) << std::right
+                      << b.fileCount << " files, " << formatSize(b.totalSize) << '\n';
+        }
+    }
+
+    if (options.byExtension) {
+        std::cout << "\nExtensions (recursive):\n";
+        for (const auto& e : report.extensions) {
+            std::string label = e.extension.empty() ? "[no extension]" : e.extension;
+            std::cout << "  " << std::left << std::setw(24) << label << std::right
+                      << e.fileCount << " files, " << formatSize(e.totalSize);
+            if (options.countLines || options.countWords) std::cout << ", " << e.lines << " lines";
+            if (options.countWords) std::cout << ", " << e.words << " words";
+            std::cout << '\n';
+        }
+    }
+}
+
+static void printEstimate(const fs::path& target, const StatsEstimate& e, bool ndjson) {
+    auto bytes = [](double v) { return static_cast<std::uintmax_t>(std::llround(std::max(0.0, v))); };
+    if (ndjson) {
+        std::cout << "{\"type\":\"estimate\",\"path\":\"" << jsonEscape(target.string())
+                  << "\",\"exact\":" << (e.exact ? "true" : "false") << ",\"samples\":" << e.samples
+                  << ",\"directories_read\":" << e.directoriesRead
+                  << ",\"files\":" << std::llround(e.files) << ",\"files_margin\":" << std::llround(e.filesMargin)
+                  << ",\"dirs\":" << std::llround(e.dirs) << ",\"dirs_margin\":" << std::llround(e.dirsMargin)
+                  << ",\"size\":" << bytes(e.bytes) << ",\"size_margin\":" << bytes(e.bytesMargin) << "}\n";
+        return;
+    }
+
+    if (e.exact) {
+        std::cout << "Exact totals (every directory read, " << e.directoriesRead << " directories):\n";
+        std::cout << "Total files (recursive): " << std::llround(e.files) << '\n';
+        std::cout << "Total directories (recursive): " << std::llround(e.dirs) << '\n';
+        std::cout << "Total size (recursive): " << formatSize(bytes(e.bytes)) << '\n';
+        return;
+    }
+    std::cout << "Estimated from " << e.samples << " random descents (" << e.directoriesRead
+              << " directories read), 95% confidence:\n";
+    std::cout << "Total files (recursive): ~" << std::llround(e.files) << " ± " << std::llround(e.filesMargin) << '\n';
+    std::cout << "Total directories (recursive): ~" << std::llround(e.dirs) << " ± " << std::llround(e.dirsMargin)
+              << '\n';
+    std::cout << "Total size (recursive): ~" << formatSize(bytes(e.bytes)) << " ± " << formatSize(bytes(e.bytesMargin))
+              << '\n';
 }
 
 // Run command for StatsTool
@@ -134,6 +1172,15 @@ void StatsCommand::run() const {
             std::exit(1);
         }
 
+        if (format == "ndjson" && fs::is_regular_file(target)) {
+            // File mode, single NDJSON record
+            FileMeta meta;
+            readFileMeta(fs::directory_entry(target), meta);
+            std::cout << "{\"type\":\"file\",\"path\":\"" << jsonEscape(target.string())
+                      << "\",\"size\":" << meta.size << ",\"allocated\":" << meta.allocated << "}\n";
+            return;
+        }
+
         if (fs::is_regular_file(target)) {
             // File mode
             std::uintmax_t size = 0;
@@ -145,6 +1192,10 @@ void StatsCommand::run() const {
             std::cout << "Type: " << target.extension().string() << '\n';
             std::cout << "Size: " << formatSize(size) << '\n';
 
+            FileMeta meta;
+            readFileMeta(fs::directory_entry(target), meta);
+            std::cout << "Allocated size: " << formatSize(meta.allocated) << '\n';
+
             // Last modified
             std::error_code ec2;
             auto lw = fs::last_write_time(target, ec2);
@@ -154,27 +1205,72 @@ void StatsCommand::run() const {
             return;
         }
 
+        if (fs::is_directory(target) && estimate) {
+            // Sampling estimate mode; refinements go to stderr while sampling
+            EstimateProgress onProgress;
+            if (format == "text") {
+                std::cout << "Directory: " << fs::absolute(target) << '\n';
+                onProgress = [](const StatsEstimate& e) {
+                    std::cerr << "  after " << e.samples << " samples: ~" << std::llround(e.files) << " files, ~"
+                              << formatSize(static_cast<std::uintmax_t>(std::llround(e.bytes))) << '\n';
+                };
+            }
+            StatsEstimate e = estimateDirectoryStats(target.string(), estimateSamples, estimateSeconds, 0, onProgress);
+            printEstimate(target, e, format == "ndjson");
+            return;
+        }
+
         if (fs::is_directory(target)) {
             // Directory mode
+            StatsOptions options;
+            options.jobs = jobs;
+            options.topN = topN;
+            options.histogram = histogram;
+            options.byExtension = byExtension;
+            options.oneFileSystem = oneFileSystem;
+            options.countLines = lines || words;
+            options.countWords = words;
+
+            if (format == "ndjson") {
+                streamDirectoryStats(target.string(), options, std::cout, sorted);
+                return;
+            }
+
             std::cout << "Directory: " << fs::absolute(target) << '\n';
-            DirectoryTotals totals = computeDirectoryTotals(target.string());
+
+            StatsReport report = collectDirectoryStats(target.string(), options);
+            const DirectoryTotals& totals = report.totals;
             std::cout << "Total files (recursive): " << totals.totalFiles << '\n';
             std::cout << "Total directories (recursive): " << totals.totalDirs << '\n';
             std::cout << "Total size (recursive): " << formatSize(totals.totalSize) << '\n';
+            std::cout << "Allocated size (recursive): " << formatSize(totals.allocatedSize) << '\n';
+            if (totals.duplicateLinks > 0) {
+                std::cout << "Hard links counted once: " << totals.duplicateLinks << " extra path(s) skipped\n";
+            }
+            if (options.countLines) {
+                std::cout << "Total lines (recursive): " << totals.totalLines << '\n';
+            }
+            if (options.countWords) {
+                std::cout << "Total words (recursive): " << totals.totalWords << '\n';
+            }
             std::cout << '\n';
 
             // Immediate files grouped by extension
-            auto files = listImmediateFiles(target.string());
+            const auto& files = report.files;
             if (!files.empty()) {
                 std::cout << "Files (immediate):\n";
                 std::string currentExt;
-                for (const auto& f : files) {
+                for (std::size_t i = 0; i < files.size(); ++i) {
+                    const FileEntry f = files[i];
                     if (f.extension != currentExt) {
                         currentExt = f.extension;
                         if (currentExt.empty()) std::cout << "  [no extension]\n";
                         else std::cout << "  " << currentExt << '\n';
                     }
-                    std::cout << "    " << f.filename << " — " << formatSize(f.size) << '\n';
+                    std::cout << "    " << f.filename << " — " << formatSize(f.size);
+                    if (options.countLines) std::cout << ", " << f.lines << " lines";
+                    if (options.countWords) std::cout << ", " << f.words << " words";
+                    std::cout << '\n';
                 }
                 std::cout << '\n';
             } else {
@@ -182,17 +1278,24 @@ void StatsCommand::run() const {
             }
 
             // Immediate subdirectories summary
-            auto subdirs = listImmediateSubdirs(target.string());
+            const auto& subdirs = report.subdirs;
             if (!subdirs.empty()) {
                 std::cout << "Subdirectories (immediate):\n";
-                for (const auto& sd : subdirs) {
+                for (std::size_t i = 0; i < subdirs.size(); ++i) {
+                    const SubdirEntry sd = subdirs[i];
                     std::cout << "  " << sd.dirpath << '\n';
                     std::cout << "    Total size (recursive): " << formatSize(sd.totalSize) << '\n';
+                    std::cout << "    Allocated size (recursive): " << formatSize(sd.allocatedSize) << '\n';
+                    if (options.countLines) {
+                        std::cout << "    Line count (recursive): " << sd.lineCount << '\n';
+                    }
                     std::cout << "    File count (recursive): " << sd.fileCount << '\n';
                 }
             } else {
                 std::cout << "No immediate subdirectories.\n";
             }
+
+            printTreeSummaries(report, options);
             return;
         }
 
@@ -1,41 +1,702 @@
 #include "../include/tree_tool.h"
+#include "../include/stats_tool.h"
+#include "../include/work_stealing.h"
+#include "../include/file_identity.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
 #include <filesystem>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 
-// Print directory tree structure
-void printTreeRecursive(
-    const fs::path& path,
-    const std::string& prefix,
-    bool isLast,
-    bool dirsOnly
-) {
-    std::vector<fs::directory_entry> entries;
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+// One directory of the --du walk. Totals are folded into the parent once
+// the listing and every subdirectory are done, so all subtree sizes come
+// out of a single post-order traversal.
+struct DuWalkNode {
+    fs::path path;
+    DuNode* node = nullptr;          // null below the displayed depth
+    DuWalkNode* parent = nullptr;
+    std::size_t depth = 0;
+    std::atomic<std::uintmax_t> size{0};
+    std::atomic<std::uintmax_t> files{0};
+    std::atomic<std::size_t> pending{1};   // own listing + unfinished children
+};
+
+// Metadata from one stat call: sort keys and hard link identity
+struct EntryMeta {
+    std::uintmax_t size = 0;
+    std::int64_t mtime = 0;
+    std::uintmax_t links = 1;
+    FileId id;
+};
+
+void readEntryMeta(const fs::directory_entry& entry, EntryMeta& meta) {
+#if !defined(_WIN32)
+    struct stat st;
+    if (::stat(entry.path().c_str(), &st) != 0) return;
+    meta.size = static_cast<std::uintmax_t>(st.st_size);
+    meta.mtime = static_cast<std::int64_t>(st.st_mtime);
+    meta.links = static_cast<std::uintmax_t>(st.st_nlink);
+    meta.id = FileId{static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino)};
+#else
+    std::error_code ec;
+    meta.size = entry.file_size(ec);
+    if (ec) meta.size = 0;
+    auto ft = entry.last_write_time(ec);
+    if (!ec) meta.mtime = std::chrono::duration_cast<std::chrono::seconds>(ft.time_since_epoch()).count();
+#endif
+}
+
+// Sort key of one entry, extracted once before sorting
+struct SortKey {
+    std::string_view name;
+    std::uintmax_t size = 0;
+    std::int64_t mtime = 0;
+    bool isDir = false;
+};
+
+bool keyLess(const SortKey& a, const SortKey& b, const TreeOptions& options) {
+    if (options.dirsFirst && a.isDir != b.isDir) return a.isDir;
+    switch (options.sort) {
+        case TreeSort::Natural:
+            return naturalLess(a.name, b.name);
+        case TreeSort::Size:
+            if (a.size != b.size) return a.size > b.size;
+            return a.name < b.name;
+        case TreeSort::Mtime:
+            if (a.mtime != b.mtime) return a.mtime > b.mtime;
+            return a.name < b.name;
+        case TreeSort::Name:
+            return a.name < b.name;
+        case TreeSort::None:
+            break;
+    }
+    return false;
+}
+
+struct DuWalk {
+    const TreeOptions& options;
+    WorkStealingPool<DuWalkNode*> pool;
+    FileIdSet seenLinks;
+    std::error_code rootError;
+
+    DuWalk(const TreeOptions& opts, unsigned jobs) : options(opts), pool(jobs) {}
+
+    void release(DuWalkNode* w) {
+        while (w && w->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            const std::uintmax_t size = w->size.load(std::memory_order_relaxed);
+            const std::uintmax_t files = w->files.load(std::memory_order_relaxed);
+            if (w->node) {
+                w->node->size = size;
+                w->node->files = files;
+            }
+            DuWalkNode* parent = w->parent;
+            if (parent) {
+                parent->size.fetch_add(size, std::memory_order_relaxed);
+                parent->files.fetch_add(files, std::memory_order_relaxed);
+            }
+            delete w;
+            w = parent;
+        }
+    }
+
+    void process(DuWalkNode* w, unsigned worker) {
+        // Entries are kept only down to the depth that will be displayed;
+        // deeper subtrees are still walked for their totals
+        const bool keep = w->node && (options.maxDepth == 0 || w->depth < options.maxDepth);
+        std::uintmax_t size = 0;
+        std::uintmax_t files = 0;
+
+        std::error_code ec;
+        fs::directory_iterator it(w->path, ec);
+        if (ec && w->depth == 0) rootError = ec;
+
+        for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+            const fs::directory_entry& entry = *it;
+            std::error_code typeEc;
+
+            if (entry.is_directory(typeEc) && !typeEc) {
+                DuNode* child = nullptr;
+                if (keep) {
+                    w->node->children.push_back(std::make_unique<DuNode>());
+                    child = w->node->children.back().get();
+                    child->name = entry.path().filename().string();
+                    child->isDir = true;
+                    if (options.sort == TreeSort::Mtime) {
+                        EntryMeta meta;
+                        readEntryMeta(entry, meta);
+                        child->mtime = meta.mtime;
+                    }
+                }
+                // Symlinked directories are listed but not followed
+                if (entry.is_symlink(typeEc)) continue;
+
+                auto* sub = new DuWalkNode;
+                sub->path = entry.path();
+                sub->node = child;
+                sub->parent = w;
+                sub->depth = w->depth + 1;
+                w->pending.fetch_add(1, std::memory_order_relaxed);
+                pool.push(worker, sub);
+                continue;
+            }
+
+            EntryMeta meta;
+            if (entry.is_regular_file(typeEc) && !typeEc) {
+                readEntryMeta(entry, meta);
+                // Hard links: count each (device, inode) once
+                if (meta.links <= 1 || seenLinks.insert(meta.id)) {
+                    size += meta.size;
+                    ++files;
+                }
+            }
+            if (keep && !options.dirsOnly) {
+                w->node->children.push_back(std::make_unique<DuNode>());
+                DuNode& leaf = *w->node->children.back();
+                leaf.name = entry.path().filename().string();
+                leaf.size = meta.size;
+                leaf.mtime = meta.mtime;
+            }
+        }
+
+        w->size.fetch_add(size, std::memory_order_relaxed);
+        w->files.fetch_add(files, std::memory_order_relaxed);
+        release(w);
+    }
+};
+
+std::string duAnnotation(const DuNode& node) {
+    std::string text = " (" + formatSize(node.size);
+    if (node.isDir) text += ", " + std::to_string(node.files) + (node.files == 1 ? " file" : " files");
+    return text + ")";
+}
+
+} // namespace
+
+// Walk the tree once with jobs workers (0 = one per core) and return every
+// entry down to options.maxDepth with recursive size and file count
+std::unique_ptr<DuNode> buildDuTree(const fs::path& root, const TreeOptions& options, unsigned jobs) {
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    auto tree = std::make_unique<DuNode>();
+    tree->name = root.filename().string();
+    tree->isDir = true;
+
+    DuWalk walk(options, jobs);
+    auto* top = new DuWalkNode;
+    top->path = root;
+    top->node = tree.get();
+    walk.pool.push(0, top);
+    walk.pool.run([&walk](DuWalkNode* w, unsigned worker) { walk.process(w, worker); });
+
+    if (walk.rootError) throw fs::filesystem_error("directory_iterator", root, walk.rootError);
+    return tree;
+}
+
+DirectoryPrefetcher::DirectoryPrefetcher(unsigned threads, std::size_t maxListings)
+    : m_maxListings(std::max<std::size_t>(1, maxListings)) {
+    for (unsigned i = 0; i < std::max(1u, threads); ++i) {
+        m_workers.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+DirectoryPrefetcher::~DirectoryPrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_workCv.notify_all();
+    for (auto& t : m_workers) t.join();
+}
+
+void DirectoryPrefetcher::request(const std::vector<fs::path>& directories) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Newly requested directories are deeper in the walk than anything
+    // already queued, so they go to the front (keeping their order)
+    std::size_t position = 0;
+    for (const auto& dir : directories) {
+        if (m_slots.size() >= m_maxListings) break;
+        if (!m_slots.try_emplace(dir.native()).second) continue;
+        m_queue.insert(m_queue.begin() + static_cast<std::ptrdiff_t>(position++), dir.native());
+    }
+    if (position > 0) m_workCv.notify_all();
+}
+
+std::vector<fs::directory_entry> DirectoryPrefetcher::take(const fs::path& directory) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_slots.find(directory.native());
+    if (it != m_slots.end() && it->second.state != Slot::Queued) {
+        m_readyCv.wait(lock, [&]() { return it->second.state == Slot::Ready; });
+        Slot slot = std::move(it->second);
+        m_slots.erase(it);
+        lock.unlock();
+        m_workCv.notify_one();
+        if (slot.error) std::rethrow_exception(slot.error);
+        return std::move(slot.entries);
+    }
+    // Not started yet: read it now rather than wait for a worker
+    if (it != m_slots.end()) m_slots.erase(it);
+    lock.unlock();
+    return readListing(directory);
+}
+
+void DirectoryPrefetcher::discard(const std::vector<fs::path>& directories) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& dir : directories) {
+        auto it = m_slots.find(dir.native());
+        if (it == m_slots.end()) continue;
+        if (it->second.state == Slot::Running) it->second.discarded = true;   // worker erases it
+        else m_slots.erase(it);
+    }
+}
 
-    for (const auto& entry : fs::directory_iterator(path)) {
-        if (dirsOnly && !entry.is_directory())
+std::vector<fs::directory_entry> DirectoryPrefetcher::readListing(const fs::path& directory) {
+    return std::vector<fs::directory_entry>(fs::directory_iterator(directory), fs::directory_iterator{});
+}
+
+void DirectoryPrefetcher::workerLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_workCv.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+        if (m_stop) return;
+
+        fs::path::string_type key = std::move(m_queue.front());
+        m_queue.pop_front();
+        auto it = m_slots.find(key);
+        if (it == m_slots.end() || it->second.state != Slot::Queued) continue;   // taken meanwhile
+        it->second.state = Slot::Running;
+        lock.unlock();
+
+        std::vector<fs::directory_entry> entries;
+        std::exception_ptr error;
+        try {
+            entries = readListing(fs::path(key));
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+        // Running slots are only erased by take() after they become Ready
+        Slot& slot = m_slots.at(key);
+        if (slot.discarded) {
+            m_slots.erase(key);
             continue;
-        entries.push_back(entry);
+        }
+        slot.entries = std::move(entries);
+        slot.error = error;
+        slot.state = Slot::Ready;
+        m_readyCv.notify_all();
     }
+}
 
-    for (size_t i = 0; i < entries.size(); ++i) {
-        const bool last = (i == entries.size() - 1);
-        const auto& entry = entries[i];
+TreeRenderer::TreeRenderer(std::ostream& out, const TreeOptions& options)
+    : m_out(out), m_options(options) {
+    m_buffer.reserve(kTreeOutputBufferSize);
+    if (options.prefetch > 0) {
+        m_prefetcher = std::make_unique<DirectoryPrefetcher>(options.prefetch,
+                                                             options.prefetch * kTreePrefetchListingsPerThread);
+    }
+}
 
-        std::cout << prefix
-                  << (last ? "└── " : "├── ")
-                  << entry.path().filename().string()
-                  << "\n";
+TreeRenderer::~TreeRenderer() {
+    flush();
+}
+
+void TreeRenderer::flush() {
+    if (!m_buffer.empty()) {
+        m_out.write(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+        m_buffer.clear();
+    }
+    m_out.flush();
+}
+
+void TreeRenderer::writeLine(std::string_view text) {
+    m_buffer.append(text);
+    m_buffer.push_back('\n');
+    if (m_buffer.size() >= kTreeOutputBufferSize) {
+        m_out.write(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+        m_buffer.clear();
+    }
+}
+
+void TreeRenderer::writeEntry(bool last, std::string_view name) {
+    m_buffer.append(m_prefix);
+    m_buffer.append(last ? "└── " : "├── ");
+    writeLine(name);
+}
+
+bool TreeRenderer::fileMatches(std::string_view name) const {
+    if (!m_options.excludePattern.empty() && globMatchAny(m_options.excludePattern, name)) return false;
+    return m_options.includePattern.empty() || globMatchAny(m_options.includePattern, name);
+}
+
+// --prune: does the subtree hold any file that passes the filters? Stops at
+// the first one found and does not follow symlinked directories. Answers
+// are cached so rendering does not scan a subtree again, but only where
+// they can still be asked for: a directory without a match is hidden, so
+// the entries of its subdirectories are dropped when it returns. What stays
+// is the subdirectories scanned along the path to the first match, and
+// isVisible removes each entry as the renderer reaches it.
+bool TreeRenderer::hasMatchingFile(const fs::path& directory) {
+    auto cached = m_pruneCache.find(directory.native());
+    if (cached != m_pruneCache.end()) return cached->second;
+
+    bool found = false;
+    std::vector<fs::path::string_type> emptySubdirs;
+    std::error_code ec;
+    fs::directory_iterator it(directory, ec);
+    for (; !found && !ec && it != fs::directory_iterator(); it.increment(ec)) {
+        const fs::directory_entry& entry = *it;
+        const std::string name = entry.path().filename().string();
+        std::error_code typeEc;
+        if (entry.is_directory(typeEc) && !typeEc) {
+            if (entry.is_symlink(typeEc) || globMatchAny(m_options.excludePattern, name)) continue;
+            found = hasMatchingFile(entry.path());
+            if (!found) emptySubdirs.push_back(entry.path().native());
+        } else {
+            found = fileMatches(name);
+        }
+    }
+    if (!found) {
+        for (const auto& subdir : emptySubdirs) m_pruneCache.erase(subdir);
+    }
+    m_pruneCache.emplace(directory.native(), found);
+    return found;
+}
 
-        if (entry.is_directory()) {
-            std::string newPrefix = prefix + (last ? "    " : "│   ");
-            printTreeRecursive(entry.path(), newPrefix, last, dirsOnly);
+// Drop the cached answers below a directory that will not be rendered
+void TreeRenderer::forgetPruneSubtree(const fs::path& directory) {
+    if (m_pruneCache.empty()) return;
+    fs::path::string_type prefix = directory.native();
+    prefix.push_back(fs::path::preferred_separator);
+    for (auto it = m_pruneCache.begin(); it != m_pruneCache.end();) {
+        if (it->first.compare(0, prefix.size(), prefix) == 0) {
+            it = m_pruneCache.erase(it);
+        } else {
+            ++it;
         }
     }
 }
 
+bool TreeRenderer::isVisible(const fs::directory_entry& entry) {
+    const bool isDir = entry.is_directory();
+    if (m_options.dirsOnly && !isDir)
+        return false;
+    if (!isDir)
+        return fileMatches(entry.path().filename().string());
+    if (!m_options.excludePattern.empty() && globMatchAny(m_options.excludePattern, entry.path().filename().string()))
+        return false;
+    if (!m_options.prune) return true;
+
+    // Each directory's visibility is asked once, so its entry can go
+    const bool visible = hasMatchingFile(entry.path());
+    m_pruneCache.erase(entry.path().native());
+    return visible;
+}
+
+void TreeRenderer::renderEntry(const fs::directory_entry& entry, bool last, std::size_t depth) {
+    writeEntry(last, entry.path().filename().string());
+
+    if ((m_options.maxDepth == 0 || depth < m_options.maxDepth) && entry.is_directory()) {
+        const std::size_t mark = m_prefix.size();
+        m_prefix.append(last ? "    " : "│   ");
+        renderChildren(entry.path(), depth + 1);
+        m_prefix.resize(mark);
+    } else if (m_options.prune) {
+        forgetPruneSubtree(entry.path());
+    }
+}
+
+// Order a directory listing. Keys come from the cached entry
+// type plus at most one stat per entry (size and mtime sorts only), so
+// the comparator never touches the filesystem.
+void TreeRenderer::sortEntries(std::vector<fs::directory_entry>& entries) const {
+    struct Keyed {
+        fs::directory_entry entry;
+        std::string name;
+        std::uintmax_t size = 0;
+        std::int64_t mtime = 0;
+        bool isDir = false;
+    };
+    const bool needStat = m_options.sort == TreeSort::Size || m_options.sort == TreeSort::Mtime;
+
+    std::vector<Keyed> keyed;
+    keyed.reserve(entries.size());
+    for (auto& entry : entries) {
+        Keyed k;
+        k.entry = std::move(entry);
+        const fs::directory_entry& e = k.entry;
+        k.name = e.path().filename().string();
+        std::error_code typeEc;
+        k.isDir = e.is_directory(typeEc) && !typeEc;
+        if (needStat) {
+            EntryMeta meta;
+            readEntryMeta(e, meta);
+            k.size = k.isDir ? 0 : meta.size;
+            k.mtime = meta.mtime;
+        }
+        keyed.push_back(std::move(k));
+    }
+
+    auto key = [](const Keyed& k) { return SortKey{k.name, k.size, k.mtime, k.isDir}; };
+    std::stable_sort(keyed.begin(), keyed.end(), [&](const Keyed& a, const Keyed& b) {
+        return keyLess(key(a), key(b), m_options);
+    });
+
+    entries.clear();
+    for (auto& k : keyed) entries.push_back(std::move(k.entry));
+}
+
+// Queue the subdirectories the renderer is about to open, in output order
+std::vector<fs::path> TreeRenderer::prefetchSubdirs(const std::vector<fs::directory_entry>& entries,
+                                                    std::size_t depth) {
+    if (m_options.maxDepth != 0 && depth >= m_options.maxDepth) return {};
+
+    std::vector<fs::path> upcoming;
+    for (const auto& entry : entries) {
+        std::error_code typeEc;
+        if (!entry.is_directory(typeEc) || typeEc) continue;
+        if (globMatchAny(m_options.excludePattern, entry.path().filename().string())) continue;
+        upcoming.push_back(entry.path());
+        if (m_options.maxEntriesPerDir != 0 && upcoming.size() == m_options.maxEntriesPerDir) break;
+    }
+    m_prefetcher->request(upcoming);
+    return upcoming;
+}
+
+// Print directory tree structure. Entries are streamed from the directory
+// with one visible entry of lookahead: an entry is printed (and its
+// subtree rendered) once the next visible sibling is known, which decides
+// its connector. Only the open directories on the current path are held.
+void TreeRenderer::renderChildren(const fs::path& directory, std::size_t depth) {
+    const std::size_t limit = m_options.maxEntriesPerDir;
+    std::optional<fs::directory_entry> pending;
+    std::size_t shown = 0;
+    std::size_t hidden = 0;
+
+    auto visit = [&](const fs::directory_entry& entry) {
+        if (!isVisible(entry))
+            return;
+        if (limit != 0 && shown == limit) {
+            ++hidden;
+            return;
+        }
+        if (pending) renderEntry(*pending, false, depth);
+        pending = entry;
+        ++shown;
+    };
+
+    const bool sorted = m_options.sort != TreeSort::None || m_options.dirsFirst;
+    if (m_prefetcher) {
+        std::vector<fs::directory_entry> entries = m_prefetcher->take(directory);
+        if (sorted) sortEntries(entries);
+        const std::vector<fs::path> upcoming = prefetchSubdirs(entries, depth);
+        for (const auto& entry : entries) visit(entry);
+        if (pending) renderEntry(*pending, hidden == 0, depth);
+        pending.reset();
+        // Free listings of subdirectories that were hidden (e.g. by --prune)
+        m_prefetcher->discard(upcoming);
+    } else if (sorted) {
+        std::vector<fs::directory_entry> entries(fs::directory_iterator(directory), fs::directory_iterator{});
+        sortEntries(entries);
+        for (const auto& entry : entries) visit(entry);
+    } else {
+        for (const auto& entry : fs::directory_iterator(directory)) visit(entry);
+    }
+
+    if (pending) renderEntry(*pending, hidden == 0, depth);
+
+    if (hidden > 0) {
+        writeEntry(true, "... " + std::to_string(hidden) + " more");
+    }
+}
+
+void TreeRenderer::renderDu(const DuNode& root) {
+    writeLine(root.name + duAnnotation(root));
+    renderDuChildren(root);
+}
+
+void TreeRenderer::renderDuChildren(const DuNode& directory) {
+    const std::size_t limit = m_options.maxEntriesPerDir;
+    std::vector<const DuNode*> shown;
+    std::size_t hidden = 0;
+    std::size_t small = 0;
+    std::uintmax_t smallSize = 0;
+
+    std::vector<const DuNode*> ordered;
+    ordered.reserve(directory.children.size());
+    for (const auto& child : directory.children) ordered.push_back(child.get());
+    if (m_options.sort != TreeSort::None || m_options.dirsFirst) {
+        std::stable_sort(ordered.begin(), ordered.end(), [this](const DuNode* a, const DuNode* b) {
+            return keyLess(SortKey{a->name, a->size, a->mtime, a->isDir},
+                           SortKey{b->name, b->size, b->mtime, b->isDir}, m_options);
+        });
+    }
+
+    for (const DuNode* child : ordered) {
+        if (m_options.dirsOnly && !child->isDir)
+            continue;
+        if (child->isDir ? globMatchAny(m_options.excludePattern, child->name) : !fileMatches(child->name))
+            continue;
+        if (child->size < m_options.minSize) {
+            ++small;
+            smallSize += child->size;
+            continue;
+        }
+        if (limit != 0 && shown.size() == limit) {
+            ++hidden;
+            continue;
+        }
+        shown.push_back(child);
+    }
+
+    const std::size_t trailers = (hidden > 0) + (small > 0);
+    for (size_t i = 0; i < shown.size(); ++i) {
+        const bool last = (i == shown.size() - 1) && trailers == 0;
+        const DuNode& entry = *shown[i];
+
+        writeEntry(last, entry.name + duAnnotation(entry));
+
+        if (entry.isDir && !entry.children.empty()) {
+            const std::size_t mark = m_prefix.size();
+            m_prefix.append(last ? "    " : "│   ");
+            renderDuChildren(entry);
+            m_prefix.resize(mark);
+        }
+    }
+
+    if (hidden > 0) {
+        writeEntry(small == 0, "... " + std::to_string(hidden) + " more");
+    }
+    if (small > 0) {
+        writeEntry(true, "... " + std::to_string(small) + " below " + formatSize(m_options.minSize) +
+                         " (" + formatSize(smallSize) + ")");
+    }
+}
+
+// Shell-style match of one pattern: * (any run), ? (one character) and
+// [set] / [!set] with a-z ranges
+bool globMatch(std::string_view pattern, std::string_view name) {
+    std::size_t p = 0, n = 0;
+    std::size_t starP = std::string_view::npos, starN = 0;
+
+    while (n < name.size()) {
+        if (p < pattern.size() && pattern[p] == '*') {
+            starP = p++;
+            starN = n;
+            continue;
+        }
+        if (p < pattern.size() && pattern[p] == '[') {
+            std::size_t q = p + 1;
+            const bool negate = q < pattern.size() && (pattern[q] == '!' || pattern[q] == '^');
+            if (negate) ++q;
+            bool matched = false;
+            bool first = true;
+            while (q < pattern.size() && (first || pattern[q] != ']')) {
+                first = false;
+                char lo = pattern[q];
+                char hi = lo;
+                if (q + 2 < pattern.size() && pattern[q + 1] == '-' && pattern[q + 2] != ']') {
+                    hi = pattern[q + 2];
+                    q += 2;
+                }
+                if (lo <= name[n] && name[n] <= hi) matched = true;
+                ++q;
+            }
+            if (q < pattern.size() && matched != negate) {
+                p = q + 1;
+                ++n;
+                continue;
+            }
+        } else if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+            ++p;
+            ++n;
+            continue;
+        }
+        // Mismatch: let the last * absorb one more character
+        if (starP == std::string_view::npos) return false;
+        p = starP + 1;
+        n = ++starN;
+    }
+    while (p < pattern.size() && pattern[p] == '*') ++p;
+    return p == pattern.size();
+}
+
+// Natural order: runs of digits compare by numeric value, so "file9"
+// sorts before "file10"; everything else compares bytewise
+bool naturalLess(std::string_view a, std::string_view b) {
+    auto isDigit = [](char c) { return c >= '0' && c <= '9'; };
+    std::size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        if (isDigit(a[i]) && isDigit(b[j])) {
+            std::size_t ai = i, bj = j;
+            while (ai < a.size() && a[ai] == '0') ++ai;
+            while (bj < b.size() && b[bj] == '0') ++bj;
+            std::size_t ae = ai, be = bj;
+            while (ae < a.size() && isDigit(a[ae])) ++ae;
+            while (be < b.size() && isDigit(b[be])) ++be;
+            // Longer run of significant digits is the larger number
+            if (ae - ai != be - bj) return ae - ai < be - bj;
+            const int cmp = a.substr(ai, ae - ai).compare(b.substr(bj, be - bj));
+            if (cmp != 0) return cmp < 0;
+            // Equal values: fewer leading zeros first
+            if (ae - i != be - j) return ae - i < be - j;
+            i = ae;
+            j = be;
+            continue;
+        }
+        if (a[i] != b[j]) return static_cast<unsigned char>(a[i]) < static_cast<unsigned char>(b[j]);
+        ++i;
+        ++j;
+    }
+    return a.size() - i < b.size() - j;
+}
+
+bool parseTreeSort(const std::string& name, TreeSort& sort) {
+    if (name == "none") sort = TreeSort::None;
+    else if (name == "name") sort = TreeSort::Name;
+    else if (name == "natural") sort = TreeSort::Natural;
+    else if (name == "size") sort = TreeSort::Size;
+    else if (name == "mtime") sort = TreeSort::Mtime;
+    else return false;
+    return true;
+}
+
+// Match against "a|b|c" alternatives, as in tree -P '*.c|*.h'
+bool globMatchAny(std::string_view patterns, std::string_view name) {
+    while (true) {
+        const std::size_t bar = patterns.find('|');
+        if (globMatch(patterns.substr(0, bar), name)) return true;
+        if (bar == std::string_view::npos) return false;
+        patterns.remove_prefix(bar + 1);
+    }
+}
+
+void printTreeRecursive(
+    const fs::path& path,
+    const std::string& prefix,
+    bool isLast,
+    bool dirsOnly
+) {
+    (void)isLast;
+    TreeOptions options;
+    options.dirsOnly = dirsOnly;
+    TreeRenderer renderer(std::cout, options);
+    renderer.setPrefix(prefix);
+    renderer.renderChildren(path);
+}
+
 // TreeCommand::run()
 void TreeCommand::run() const {
     try {
@@ -45,13 +706,35 @@ void TreeCommand::run() const {
             return;
         }
 
+        TreeOptions options;
+        options.dirsOnly = dirsOnly;
+        options.maxDepth = maxDepth;
+        options.maxEntriesPerDir = maxEntriesPerDir;
+        options.minSize = minSize;
+        options.includePattern = includePattern;
+        options.excludePattern = excludePattern;
+        options.prune = prune;
+        options.dirsFirst = dirsFirst;
+        options.prefetch = du ? 0 : prefetch;
+        if (!parseTreeSort(sort, options.sort)) {
+            std::cerr << "Error: Unknown sort order: " << sort << "\n";
+            return;
+        }
+        TreeRenderer renderer(std::cout, options);
+
+        if (du) {
+            // Aggregate first, then render with totals
+            renderer.renderDu(*buildDuTree(path, options, jobs));
+            return;
+        }
+
         // Print root name
-        std::cout << path.filename().string() << "\n";
+        renderer.writeLine(path.filename().string());
 
         // Begin recursive print
-        printTreeRecursive(path, "", true, dirsOnly);
+        renderer.renderChildren(path);
     }
     catch (const std::exception& ex) {
         std::cerr << "Error: " << ex.what() << "\n";
     }
-}
\ No newline at end of file
+}
@@ -1,9 +1,12 @@
 #include "../include/hash_tool.h"
+#include "../include/sha256.h"
+#include "../include/progress.h"
 
 #include <iostream>
 #include <fstream>
 #include <filesystem>
 #include <cassert>
+#include <sstream>
 
 namespace fs = std::filesystem;
 
@@ -75,6 +78,115 @@ int main() {
 
         assertHashEquals(subfile, subhash);
 
+        // Test pipelined hashing of a file spanning many read buffers
+        fs::path bigFile = tmpDir / "big.bin";
+        std::vector<uint8_t> bigData(3 * 1024 * 1024 + 123);
+        for (size_t i = 0; i < bigData.size(); ++i) bigData[i] = static_cast<uint8_t>(i * 31 + 7);
+        {
+            std::ofstream ofs(bigFile, std::ios::binary);
+            ofs.write(reinterpret_cast<const char*>(bigData.data()), static_cast<std::streamsize>(bigData.size()));
+        }
+        SHA256 reference;
+        reference.update(bigData);
+        reference.finalize();
+
+        bool okBig;
+        std::string bigSmallBuffers = hashFile(bigFile, okBig, 64 * 1024);
+        assert(okBig && bigSmallBuffers == reference.hexDigest());
+        std::string bigDefault = hashFile(bigFile, okBig);
+        assert(okBig && bigDefault == reference.hexDigest());
+
+        // Test quick fingerprint sampling and change detection
+        auto offsets = quickSampleOffsets(bigData.size());
+        assert(offsets.size() == kQuickSampleBlocks);
+        assert(offsets.front() == 0 && offsets.back() == bigData.size() - kQuickBlockSize);
+        assert(quickSampleOffsets(100).size() == 1);
+
+        bool okQuick;
+        std::string quick1 = quickFingerprint(bigFile, okQuick);
+        assert(okQuick && quick1 != reference.hexDigest());
+        {
+            std::fstream patch(bigFile, std::ios::in | std::ios::out | std::ios::binary);
+            patch.seekp(static_cast<std::streamoff>(offsets[5] + 10));
+            patch.put('\x42' ^ static_cast<char>(bigData[offsets[5] + 10]));
+        }
+        std::string quick2 = quickFingerprint(bigFile, okQuick);
+        assert(okQuick && quick2 != quick1);
+        fs::remove(bigFile);
+
+        // Test manifest line parsing (GNU, binary-mode and BSD formats)
+        ManifestEntry entry;
+        bool parsed = parseManifestLine(hash1 + "  " + file1.string(), 1, entry);
+        assert(parsed && entry.expectedHash == hash1 && entry.path == file1);
+        parsed = parseManifestLine(hash2 + " *" + file2.string(), 2, entry);
+        assert(parsed && entry.path == file2 && entry.lineNumber == 2);
+        parsed = parseManifestLine("SHA256 (" + file1.string() + ") = " + hash1, 3, entry);
+        assert(parsed && entry.path == file1);
+        parsed = parseManifestLine("not a manifest line", 4, entry);
+        assert(!parsed);
+        parsed = parseManifestLine(hash1.substr(1) + "  " + file1.string(), 5, entry);
+        assert(!parsed);
+
+        // Test manifest verification: OK, FAILED and MISSING entries
+        fs::path manifest = tmpDir / "SHA256SUMS";
+        {
+            std::ofstream ofs(manifest);
+            ofs << hash1 << "  " << file1.string() << "\n";
+            ofs << hash2 << "  " << file2.string() << "\n";
+            ofs << subhash << "  " << subfile.string() << "\n";
+        }
+        int status = checkManifest(manifest, 2, false);
+        assert(status == kCheckAllOk);
+
+        std::vector<ManifestEntry> entries = {
+            {hash1, file1, 1},
+            {hash1, file2, 2},
+            {hash1, tmpDir / "missing.txt", 3},
+        };
+        auto results = verifyManifestEntries(entries, 2, false);
+        assert(results.size() == 3);
+        assert(results[0].status == CheckStatus::Ok);
+        assert(results[1].status == CheckStatus::Failed);
+        assert(results[2].status == CheckStatus::Missing);
+
+        {
+            std::ofstream ofs(manifest);
+            ofs << hash1 << "  " << file2.string() << "\n";
+        }
+        status = checkManifest(manifest, 1, true);
+        assert(status == kCheckMismatch);
+        status = checkManifest(tmpDir / "no_such_manifest", 1, false);
+        assert(status == kCheckManifestError);
+
+        // Test progress counters and the rendered status line
+        std::ostringstream progressOut;
+        ProgressMeter meter("hash", progressOut);
+        meter.start();
+        std::string withProgress = hashFile(file1, ok1, kDefaultHashBufferSize, &meter);
+        assert(ok1 && withProgress == hash1);
+        ProgressSnapshot snap = meter.snapshot();
+        assert(snap.bytes == 5 && snap.files == 0);
+
+        auto progressResults = verifyManifestEntries(entries, 2, false, kDefaultHashBufferSize, &meter);
+        assert(progressResults.size() == 3);
+        snap = meter.snapshot();
+        assert(snap.totalsKnown && snap.expectedFiles == 2 && snap.expectedBytes == 10);
+        assert(snap.files == 1 && snap.errors == 1 && snap.bytes == 15);
+        meter.stop();
+        assert(progressOut.str().find("hash: 1 files, 15 B in ") == 0);
+
+        ProgressSnapshot sample;
+        sample.files = 3;
+        sample.expectedFiles = 10;
+        sample.bytes = 512 * 1024 * 1024;
+        sample.expectedBytes = 1024 * 1024 * 1024;
+        sample.totalsKnown = true;
+        std::string line = renderProgressLine("copy", sample, 64.0 * 1024 * 1024, 0, "a/b.bin");
+        assert(line == "copy: 3/10 files, 512.0 MiB of 1.0 GiB (50%), 64.0 MiB/s, ETA 0:08 - a/b.bin");
+        sample.totalsKnown = false;
+        line = renderProgressLine("copy", sample, 0, 75, "");
+        assert(line == "copy: 3 files, 512.0 MiB, 0 B/s, no progress for 1:15");
+
     } catch (const std::exception& ex) {
         std::cerr << "Exception during tests: " << ex.what() << std::endl;
         cleanup(tmpDir);
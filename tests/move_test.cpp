@@ -5,6 +5,10 @@
 #include <fstream>
 #include <cassert>
 
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#endif
+
 namespace fs = std::filesystem;
 
 static void createFile(const fs::path& p, const std::string& text = "test") {
@@ -122,6 +126,46 @@ static void test_force_overwrite() {
     fs::remove_all(base);
 }
 
+// -----------------------------------------------------------
+// Test 5: Copy fallback keeps holes and symlinks
+// -----------------------------------------------------------
+static void test_fallback_sparse_and_links() {
+    std::cout << "[TEST] Fallback keeps holes and symlinks\n";
+
+    fs::path base = fs::temp_directory_path() / "move_test_sparse";
+    fs::path srcDir = base / "source";
+    fs::path dstDir = base / "dest";
+
+    fs::remove_all(base);
+    fs::create_directories(srcDir);
+
+    const std::uintmax_t size = 16 * 1024 * 1024;
+    {
+        std::ofstream ofs(srcDir / "image.img", std::ios::binary);
+        ofs << "header";
+        ofs.seekp(static_cast<std::streamoff>(size - 6));
+        ofs << "footer";
+    }
+    fs::create_symlink("image.img", srcDir / "link");
+
+    std::string err;
+    bool result = moveRecursive(srcDir, dstDir, true, true, SparseMode::Auto, err);
+
+    assert(result == true);
+    assert(!fs::exists(srcDir));
+    assert(fs::file_size(dstDir / "image.img") == size);
+    assert(fs::is_symlink(dstDir / "link"));
+
+#if !defined(_WIN32)
+    // The copy allocates no more than the data regions (a few blocks)
+    struct stat st;
+    assert(::stat((dstDir / "image.img").c_str(), &st) == 0);
+    assert(static_cast<std::uintmax_t>(st.st_blocks) * 512 < size / 4);
+#endif
+
+    fs::remove_all(base);
+}
+
 // ===========================================================
 // main()
 // ===========================================================
@@ -131,6 +175,7 @@ int main() {
         test_move_directory_recursive();
         test_missing_source_error();
         test_force_overwrite();
+        test_fallback_sparse_and_links();
     } catch (const std::exception& e) {
         std::cerr << "[FAIL] Exception: " << e.what() << "\n";
         return 1;
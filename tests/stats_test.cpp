@@ -4,7 +4,9 @@
 #include <sstream>
 #include <filesystem>
 #include <fstream>
+#include <algorithm>
 #include <cstdlib>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -101,6 +103,345 @@ void test_directory_stats() {
 }
 
 
+// -----------------------------------------------------------------------------
+// Test that a parallel walk matches the sequential one
+// -----------------------------------------------------------------------------
+void test_parallel_stats() {
+    std::cout << "[TEST] test_parallel_stats\n";
+
+    fs::path root = fs::temp_directory_path() / "stats_ctest_parallel";
+    fs::remove_all(root);
+
+    // 4 subdirectories, each with 3 nested levels of 5 files
+    for (int d = 0; d < 4; ++d) {
+        fs::path dir = root / ("dir" + std::to_string(d));
+        for (int level = 0; level < 3; ++level) {
+            dir /= "level" + std::to_string(level);
+            fs::create_directories(dir);
+            for (int f = 0; f < 5; ++f) {
+                std::ofstream(dir / ("f" + std::to_string(f) + ".dat")) << std::string(d + 1, 'x');
+            }
+        }
+    }
+    std::ofstream(root / "top.txt") << "top";
+
+    StatsOptions options;
+    options.jobs = 1;
+    StatsReport sequential = collectDirectoryStats(root.string(), options);
+    options.jobs = 4;
+    StatsReport parallel = collectDirectoryStats(root.string(), options);
+
+    CHECK(sequential.totals.totalFiles == 61);
+    CHECK(sequential.totals.totalDirs == 16);
+    CHECK(sequential.totals.totalSize == 3 + 15 * (1 + 2 + 3 + 4));
+    CHECK(parallel.totals.totalFiles == sequential.totals.totalFiles);
+    CHECK(parallel.totals.totalDirs == sequential.totals.totalDirs);
+    CHECK(parallel.totals.totalSize == sequential.totals.totalSize);
+
+    CHECK(parallel.files.size() == 1);
+    CHECK(parallel.subdirs.size() == 4);
+    for (size_t i = 0; i < parallel.subdirs.size() && i < sequential.subdirs.size(); ++i) {
+        CHECK(parallel.subdirs[i].dirpath == sequential.subdirs[i].dirpath);
+        CHECK(parallel.subdirs[i].fileCount == 15);
+        CHECK(parallel.subdirs[i].totalSize == 15 * (i + 1));
+    }
+
+    fs::remove_all(root);
+}
+
+
+// -----------------------------------------------------------------------------
+// Test whole-tree top-N, histograms and extension breakdown
+// -----------------------------------------------------------------------------
+void test_tree_summaries() {
+    std::cout << "[TEST] test_tree_summaries\n";
+
+    fs::path root = fs::temp_directory_path() / "stats_ctest_summaries";
+    fs::remove_all(root);
+    fs::create_directories(root / "big" / "deeper");
+    fs::create_directories(root / "small");
+
+    std::ofstream(root / "big" / "deeper" / "huge.bin") << std::string(5000, 'h');  // 5000 bytes
+    std::ofstream(root / "big" / "medium.bin") << std::string(1500, 'm');           // 1500 bytes
+    std::ofstream(root / "small" / "a.txt") << std::string(10, 'a');                // 10 bytes
+    std::ofstream(root / "small" / "b.txt") << std::string(20, 'b');                // 20 bytes
+    std::ofstream(root / "empty") << "";                                           // 0 bytes
+
+    StatsOptions options;
+    options.jobs = 2;
+    options.topN = 2;
+    options.histogram = true;
+    options.byExtension = true;
+    StatsReport report = collectDirectoryStats(root.string(), options);
+
+    CHECK(report.largestFiles.size() == 2);
+    if (report.largestFiles.size() == 2) {
+        CHECK(report.largestFiles[0].size == 5000);
+        CHECK(report.largestFiles[0].path == (root / "big" / "deeper" / "huge.bin").string());
+        CHECK(report.largestFiles[1].size == 1500);
+    }
+    CHECK(report.largestDirs.size() == 2);
+    if (report.largestDirs.size() == 2) {
+        CHECK(report.largestDirs[0].path == (root / "big").string());
+        CHECK(report.largestDirs[0].size == 6500);
+        CHECK(report.largestDirs[1].path == (root / "big" / "deeper").string());
+    }
+
+    // 0 B, [8, 16), [16, 32), [1024, 2048), [4096, 8192)
+    CHECK(report.sizeHistogram.size() == 5);
+    std::uintmax_t histogramFiles = 0;
+    for (const auto& b : report.sizeHistogram) histogramFiles += b.fileCount;
+    CHECK(histogramFiles == 5);
+    CHECK(report.ageHistogram.front().fileCount == 5);   // all modified just now
+
+    CHECK(report.extensions.size() == 3);
+    if (report.extensions.size() == 3) {
+        CHECK(report.extensions[0].extension == ".bin");
+        CHECK(report.extensions[0].fileCount == 2);
+        CHECK(report.extensions[0].totalSize == 6500);
+        CHECK(report.extensions[1].extension == ".txt");
+        CHECK(report.extensions[2].extension.empty());
+    }
+
+    fs::remove_all(root);
+}
+
+
+// -----------------------------------------------------------------------------
+// Test allocated-size accounting and hard link de-duplication
+// -----------------------------------------------------------------------------
+void test_disk_usage_accounting() {
+    std::cout << "[TEST] test_disk_usage_accounting\n";
+
+    fs::path root = fs::temp_directory_path() / "stats_ctest_disk_usage";
+    fs::remove_all(root);
+    fs::create_directories(root / "a");
+    fs::create_directories(root / "b");
+
+    std::ofstream(root / "a" / "data.bin") << std::string(10000, 'd');
+    std::error_code ec;
+    fs::create_hard_link(root / "a" / "data.bin", root / "b" / "link.bin", ec);
+
+    // Sparse file: 8 MB apparent size, almost nothing allocated
+    { std::ofstream(root / "sparse.img"); }
+    fs::resize_file(root / "sparse.img", 8 * 1024 * 1024);
+
+    StatsOptions options;
+    options.jobs = 2;
+    StatsReport report = collectDirectoryStats(root.string(), options);
+
+    if (!ec) {
+        CHECK(report.totals.totalFiles == 2);
+        CHECK(report.totals.duplicateLinks == 1);
+        CHECK(report.totals.totalSize == 10000 + 8 * 1024 * 1024);
+    }
+    CHECK(report.totals.allocatedSize >= 10000);
+    CHECK(report.totals.allocatedSize < report.totals.totalSize);
+
+    fs::remove_all(root);
+}
+
+
+// -----------------------------------------------------------------------------
+// Test NDJSON streaming output (unsorted and sorted)
+// -----------------------------------------------------------------------------
+void test_ndjson_stream() {
+    std::cout << "[TEST] test_ndjson_stream\n";
+
+    fs::path root = fs::temp_directory_path() / "stats_ctest_ndjson";
+    fs::remove_all(root);
+    fs::create_directories(root / "sub");
+    std::ofstream(root / "b.txt") << "bb";
+    std::ofstream(root / "a \"quoted\".txt") << "a";
+    std::ofstream(root / "sub" / "c.txt") << "ccc";
+
+    StatsOptions options;
+    options.jobs = 2;
+
+    std::ostringstream unsortedOut;
+    DirectoryTotals totals = streamDirectoryStats(root.string(), options, unsortedOut, false);
+    CHECK(totals.totalFiles == 3);
+    CHECK(totals.totalSize == 6);
+
+    std::ostringstream sortedOut;
+    streamDirectoryStats(root.string(), options, sortedOut, true);
+
+    std::vector<std::string> lines;
+    std::istringstream in(sortedOut.str());
+    for (std::string line; std::getline(in, line);) lines.push_back(line);
+
+    // root dir, 3 files, sub dir, summary
+    CHECK(lines.size() == 6);
+    if (lines.size() == 6) {
+        CHECK(lines[0].find("{\"type\":\"dir\",\"path\":\"" + root.string() + "\"") == 0);
+        CHECK(lines[1].find("a \\\"quoted\\\".txt\",\"size\":1,") != std::string::npos);
+        CHECK(lines[2].find("b.txt\",\"size\":2,") != std::string::npos);
+        CHECK(lines[3].find("\"type\":\"dir\"") != std::string::npos);
+        CHECK(lines[4].find("c.txt\",\"size\":3,") != std::string::npos);
+        CHECK(lines[5].find("{\"type\":\"summary\"") == 0);
+        CHECK(lines[5].find("\"files\":3,\"dirs\":1,\"size\":6,") != std::string::npos);
+    }
+
+    // Same records either way, just ordered differently
+    CHECK(unsortedOut.str().size() == sortedOut.str().size());
+
+    // Through the command every stdout line is a JSON record
+    for (bool sortedRun : {false, true}) {
+        StatsCommand cmd;
+        cmd.targetPath = root.string();
+        cmd.format = "ndjson";
+        cmd.sorted = sortedRun;
+        std::string out;
+        {
+            OutputCapture capture;
+            cmd.run();
+            out = capture.str();
+        }
+        std::istringstream records(out);
+        size_t count = 0;
+        for (std::string line; std::getline(records, line); ++count) {
+            CHECK(!line.empty() && line.front() == '{' && line.back() == '}');
+        }
+        CHECK(count == 6);
+    }
+
+    fs::remove_all(root);
+}
+
+
+// -----------------------------------------------------------------------------
+// Test line and word counting (vector path, chunk boundaries, stats walk)
+// -----------------------------------------------------------------------------
+void test_line_counting() {
+    std::cout << "[TEST] test_line_counting\n";
+
+    // Word split across 16-byte blocks and across separate buffers
+    std::string text;
+    for (int i = 0; i < 200; ++i) {
+        text += "alpha beta\tgamma\v\fdelta-" + std::to_string(i) + "\r\n";
+        text += std::string(static_cast<size_t>(i % 37), 'x') + "  \n";
+    }
+    std::uintmax_t expectedLines = 400;
+    std::uintmax_t expectedWords = 0;
+    bool inWord = false;
+    for (unsigned char c : text) {
+        bool blank = c == ' ' || (c >= '\t' && c <= '\r');
+        if (!blank && !inWord) ++expectedWords;
+        inWord = !blank;
+    }
+
+    TextCounts whole;
+    countText(reinterpret_cast<const unsigned char*>(text.data()), text.size(), true, whole);
+    CHECK(whole.lines == expectedLines);
+    CHECK(whole.words == expectedWords);
+
+    TextCounts chunked;
+    for (size_t pos = 0; pos < text.size(); pos += 23) {
+        size_t len = std::min<size_t>(23, text.size() - pos);
+        countText(reinterpret_cast<const unsigned char*>(text.data() + pos), len, true, chunked);
+    }
+    CHECK(chunked.lines == expectedLines);
+    CHECK(chunked.words == expectedWords);
+
+    TextCounts linesOnly;
+    countText(reinterpret_cast<const unsigned char*>(text.data()), text.size(), false, linesOnly);
+    CHECK(linesOnly.lines == expectedLines);
+    CHECK(linesOnly.words == 0);
+
+    fs::path root = fs::temp_directory_path() / "stats_ctest_lines";
+    fs::remove_all(root);
+    fs::create_directories(root / "sub");
+    std::ofstream(root / "a.txt") << text;
+    std::ofstream(root / "sub" / "b.md") << "one two\nthree\n";
+
+    StatsOptions options;
+    options.jobs = 2;
+    options.countLines = true;
+    options.countWords = true;
+    options.byExtension = true;
+    StatsReport report = collectDirectoryStats(root.string(), options);
+
+    CHECK(report.totals.totalLines == expectedLines + 2);
+    CHECK(report.totals.totalWords == expectedWords + 3);
+    CHECK(report.files.size() == 1 && report.files[0].lines == expectedLines);
+    CHECK(report.subdirs.size() == 1 && report.subdirs[0].lineCount == 2);
+
+    fs::remove_all(root);
+}
+
+
+// -----------------------------------------------------------------------------
+// Test compact listings: interned extensions and index sort
+// -----------------------------------------------------------------------------
+void test_compact_listings() {
+    std::cout << "[TEST] test_compact_listings\n";
+
+    FileListing files;
+    files.add("b.txt", ".txt", 2);
+    files.add("README", "", 7);
+    files.add("a.cpp", ".cpp", 3, 10, 20);
+    files.add("a.txt", ".txt", 1);
+    files.sort();
+
+    CHECK(files.size() == 4);
+    CHECK(files[0].filename == "README" && files[0].extension.empty() && files[0].size == 7);
+    CHECK(files[1].filename == "a.cpp" && files[1].lines == 10 && files[1].words == 20);
+    CHECK(files[2].filename == "a.txt" && files[2].extension == ".txt");
+    CHECK(files[3].filename == "b.txt" && files[3].size == 2);
+
+    SubdirListing subdirs;
+    std::size_t zeta = subdirs.add("root/zeta");
+    subdirs.add("root/alpha");
+    subdirs.setTotals(zeta, 100, 4, 4096, 9);
+    subdirs.sort();
+    CHECK(subdirs.size() == 2);
+    CHECK(subdirs[0].dirpath == "root/alpha" && subdirs[0].totalSize == 0);
+    CHECK(subdirs[1].dirpath == "root/zeta" && subdirs[1].fileCount == 4 && subdirs[1].lineCount == 9);
+}
+
+
+// -----------------------------------------------------------------------------
+// Test sampling estimates against a full walk
+// -----------------------------------------------------------------------------
+void test_estimate() {
+    std::cout << "[TEST] test_estimate\n";
+
+    // Uniform tree: every random descent sees the same branching, so each
+    // sample is already the exact total
+    fs::path root = fs::temp_directory_path() / "stats_ctest_estimate";
+    fs::remove_all(root);
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            fs::path leaf = root / ("d" + std::to_string(i)) / ("e" + std::to_string(j));
+            fs::create_directories(leaf);
+            std::ofstream(leaf / "a.bin") << std::string(10, 'a');
+            std::ofstream(leaf / "b.bin") << std::string(10, 'b');
+        }
+    }
+
+    StatsEstimate uniform = estimateDirectoryStats(root.string(), 5, 0, 42);
+    CHECK(uniform.samples >= 1);
+    CHECK(uniform.files == 18 && uniform.dirs == 12 && uniform.bytes == 180);
+    CHECK(uniform.filesMargin == 0 && uniform.bytesMargin == 0);
+
+    // Irregular tree: enough samples read every directory and the result
+    // switches to exact totals
+    fs::create_directories(root / "d0" / "e0" / "deep" / "deeper");
+    std::ofstream(root / "d0" / "e0" / "deep" / "deeper" / "c.txt") << "hello";
+    std::ofstream(root / "top.txt") << "xyz";
+
+    DirectoryTotals walked = computeDirectoryTotals(root.string());
+    StatsEstimate exact = estimateDirectoryStats(root.string(), 100000, 0, 7);
+    CHECK(exact.exact);
+    CHECK(exact.files == static_cast<double>(walked.totalFiles));
+    CHECK(exact.dirs == static_cast<double>(walked.totalDirs));
+    CHECK(exact.bytes == static_cast<double>(walked.totalSize));
+    CHECK(exact.directoriesRead == walked.totalDirs + 1);
+
+    fs::remove_all(root);
+}
+
+
 // -----------------------------------------------------------------------------
 // Test running stats on a single file
 // -----------------------------------------------------------------------------
@@ -135,6 +476,13 @@ void test_file_stats() {
 // -----------------------------------------------------------------------------
 int main() {
     test_directory_stats();
+    test_parallel_stats();
+    test_tree_summaries();
+    test_disk_usage_accounting();
+    test_ndjson_stream();
+    test_line_counting();
+    test_compact_listings();
+    test_estimate();
     test_file_stats();
 
     std::cout << "\nTests passed: " << testsPassed << "\n";
@@ -54,6 +54,175 @@ int main() {
     assert(output2.find("file2.log") == std::string::npos);
     assert(output2.find("subdir") != std::string::npos);
 
+    // ---- Test 3: Depth limit ----
+    fs::create_directories(tmpDir / "subdir" / "deeper");
+    std::ofstream(tmpDir / "subdir" / "deeper" / "file4.txt") << "Deep";
+
+    TreeCommand cmd3;
+    cmd3.path = tmpDir.string();
+    cmd3.maxDepth = 1;
+
+    std::string output3 = captureTreeOutput(cmd3);
+
+    assert(output3.find("subdir") != std::string::npos);
+    assert(output3.find("file3.txt") == std::string::npos);
+    assert(output3.find("deeper") == std::string::npos);
+
+    cmd3.maxDepth = 2;
+    output3 = captureTreeOutput(cmd3);
+    assert(output3.find("file3.txt") != std::string::npos);
+    assert(output3.find("deeper") != std::string::npos);
+    assert(output3.find("file4.txt") == std::string::npos);
+
+    // ---- Test 4: Entries per directory limit ----
+    TreeCommand cmd4;
+    cmd4.path = tmpDir.string();
+    cmd4.maxEntriesPerDir = 1;
+
+    std::string output4 = captureTreeOutput(cmd4);
+
+    assert(output4.find("└── ... 2 more") != std::string::npos);
+    assert(output4.find("file1.txt") == std::string::npos || output4.find("file2.log") == std::string::npos);
+
+    // ---- Test 5: Aggregated sizes (--du) ----
+    // tmpDir: file1.txt (5), file2.log (5), subdir/file3.txt (6), subdir/deeper/file4.txt (4)
+    TreeOptions duOptions;
+    auto duRoot = buildDuTree(tmpDir, duOptions, 3);
+    assert(duRoot->size == 20 && duRoot->files == 4);
+    const DuNode* subNode = nullptr;
+    for (const auto& child : duRoot->children) {
+        if (child->name == "subdir") subNode = child.get();
+    }
+    assert(subNode && subNode->isDir && subNode->size == 10 && subNode->files == 2);
+
+    duOptions.maxDepth = 1;
+    auto shallow = buildDuTree(tmpDir, duOptions, 1);
+    assert(shallow->size == 20);
+    for (const auto& child : shallow->children) {
+        assert(child->children.empty());
+        if (child->name == "subdir") assert(child->size == 10);
+    }
+
+    TreeCommand cmd5;
+    cmd5.path = tmpDir.string();
+    cmd5.du = true;
+    cmd5.minSize = 6;
+
+    std::string output5 = captureTreeOutput(cmd5);
+
+    assert(output5.find("(20.0 B, 4 files)") != std::string::npos);
+    assert(output5.find("subdir (10.0 B, 2 files)") != std::string::npos);
+    assert(output5.find("file3.txt (6.00 B)") != std::string::npos);
+    assert(output5.find("file1.txt") == std::string::npos);
+    assert(output5.find("└── ... 2 below 6.00 B (10.0 B)") != std::string::npos);
+
+    // ---- Test 6: Glob filters and pruning ----
+    assert(globMatch("*.txt", "file1.txt"));
+    assert(!globMatch("*.txt", "file2.log"));
+    assert(globMatch("file[0-9].?og", "file2.log"));
+    assert(!globMatch("file[!0-9]*", "file2.log"));
+    assert(globMatch("*a*b*c", "xxaYYbZZc"));
+    assert(globMatchAny("*.c|*.log", "file2.log"));
+    assert(!globMatchAny("*.c|*.h", "file2.log"));
+
+    fs::create_directories(tmpDir / "empty_branch" / "inner");
+    std::ofstream(tmpDir / "empty_branch" / "inner" / "notes.md") << "md";
+
+    TreeCommand cmd6;
+    cmd6.path = tmpDir.string();
+    cmd6.includePattern = "*.txt";
+
+    std::string output6 = captureTreeOutput(cmd6);
+
+    assert(output6.find("file1.txt") != std::string::npos);
+    assert(output6.find("file2.log") == std::string::npos);
+    assert(output6.find("notes.md") == std::string::npos);
+    assert(output6.find("empty_branch") != std::string::npos);
+
+    cmd6.prune = true;
+    output6 = captureTreeOutput(cmd6);
+    assert(output6.find("empty_branch") == std::string::npos);
+    assert(output6.find("deeper") != std::string::npos);
+    assert(output6.find("file4.txt") != std::string::npos);
+
+    cmd6.excludePattern = "deeper";
+    output6 = captureTreeOutput(cmd6);
+    assert(output6.find("deeper") == std::string::npos);
+    assert(output6.find("file3.txt") != std::string::npos);
+
+    // Connectors still close each directory after filtering
+    cmd6.excludePattern = "subdir";
+    output6 = captureTreeOutput(cmd6);
+    assert(output6.find("subdir") == std::string::npos);
+    assert(output6.find("└── file1.txt") != std::string::npos);
+
+    // ---- Test 7: Sorting ----
+    assert(naturalLess("file9", "file10"));
+    assert(!naturalLess("file10", "file9"));
+    assert(naturalLess("a2b", "a2c"));
+    assert(naturalLess("x", "x1"));
+
+    fs::path sortDir = tmpDir / "sorted";
+    fs::create_directories(sortDir / "zdir");
+    std::ofstream(sortDir / "item10.txt") << "1";
+    std::ofstream(sortDir / "item9.txt") << "22";
+    std::ofstream(sortDir / "big.bin") << std::string(100, 'b');
+
+    TreeCommand cmd7;
+    cmd7.path = sortDir.string();
+    cmd7.sort = "name";
+    std::string byName = captureTreeOutput(cmd7);
+    assert(byName == "sorted\n├── big.bin\n├── item10.txt\n├── item9.txt\n└── zdir\n");
+
+    cmd7.sort = "natural";
+    cmd7.dirsFirst = true;
+    std::string natural = captureTreeOutput(cmd7);
+    assert(natural == "sorted\n├── zdir\n├── big.bin\n├── item9.txt\n└── item10.txt\n");
+
+    cmd7.sort = "size";
+    cmd7.dirsFirst = false;
+    std::string bySize = captureTreeOutput(cmd7);
+    assert(bySize == "sorted\n├── big.bin\n├── item9.txt\n├── item10.txt\n└── zdir\n");
+
+    // ---- Test 8: Prefetching gives the same output ----
+    TreeCommand cmd8;
+    cmd8.path = tmpDir.string();
+    cmd8.sort = "name";
+    std::string sequential = captureTreeOutput(cmd8);
+    cmd8.prefetch = 3;
+    std::string prefetched = captureTreeOutput(cmd8);
+    assert(prefetched == sequential);
+
+    cmd8.includePattern = "*.txt";
+    cmd8.prune = true;
+    cmd8.maxEntriesPerDir = 2;
+    prefetched = captureTreeOutput(cmd8);
+    cmd8.prefetch = 0;
+    sequential = captureTreeOutput(cmd8);
+    assert(prefetched == sequential);
+
+    // ---- Test 9: --prune does not keep answers for directories it passed ----
+    fs::path pruneDir = tmpDir / "prune";
+    for (int i = 0; i < 200; ++i) fs::create_directories(pruneDir / ("empty" + std::to_string(i)) / "inner");
+    fs::create_directories(pruneDir / "a" / "b" / "c");
+    fs::create_directories(pruneDir / "a" / "b" / "skipped" / "inner");
+    std::ofstream(pruneDir / "a" / "b" / "c" / "match.txt") << "m";
+
+    for (std::size_t maxDepth : {std::size_t{0}, std::size_t{1}, std::size_t{2}}) {
+        TreeOptions pruneOptions;
+        pruneOptions.prune = true;
+        pruneOptions.includePattern = "*.txt";
+        pruneOptions.maxDepth = maxDepth;
+        std::ostringstream pruneOut;
+        TreeRenderer renderer(pruneOut, pruneOptions);
+        renderer.renderChildren(pruneDir);
+        renderer.flush();
+        assert(renderer.pruneCacheSize() == 0);
+        assert(pruneOut.str().find("empty") == std::string::npos);
+        assert(pruneOut.str().find("└── a") != std::string::npos);
+        assert((pruneOut.str().find("match.txt") != std::string::npos) == (maxDepth == 0));
+    }
+
     // Cleanup
     fs::remove_all(tmpDir);
 